@@ -0,0 +1,110 @@
+#ifndef ANCHOR_PREFETCHER_HPP
+#define ANCHOR_PREFETCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <type_traits>
+#include <utility>
+
+#include "RapMapUtils.hpp"
+#include "UtilityFunctions.hpp"
+
+/**
+ * Loads the index entries of upcoming reads into the cache while the
+ * current read is mapped.  The hit collector begins with the first k-mer
+ * of a read: it looks the k-mer up in the index's hash, and then searches
+ * the interval of the suffix array that the hash gives.  Both are cache
+ * misses, and the second depends on the first, so they are pipelined over
+ * two reads:
+ *
+ *  - prefetchBucket() starts loading the hash bucket of a read's first
+ *    k-mer (for the read after next), without waiting for it;
+ *  - prefetchInterval() looks the k-mer up (for the next read, whose
+ *    bucket should be cached by then), and starts loading the ends and
+ *    middle of its suffix array interval, where the search begins.
+ *
+ * The hash is a dense_hash_map, which keeps its buckets in one array and
+ * puts most keys in the bucket their hash maps to.  The address of that
+ * array isn't exposed, so it is worked out once from where such keys are
+ * stored; if that fails, prefetchBucket() does nothing.
+ */
+template <typename IndexT>
+class AnchorPrefetcher {
+  public:
+    explicit AnchorPrefetcher(IndexT* sidx) :
+        sidx_(sidx), k_(rapmap::utils::my_mer::k()) {
+        findBuckets_();
+    }
+
+    // Start loading the hash bucket of the first k-mer of s[0, len)
+    void prefetchBucket(const char* s, size_t len) const {
+        uint64_t anchor{0};
+        if (buckets_ == 0 or !firstKmer_(s, len, anchor)) { return; }
+        size_t b = sidx_->khash.hash_funct()(anchor) & bucketMask_;
+        __builtin_prefetch(reinterpret_cast<const void*>(buckets_ + b * sizeof(Bucket)));
+    }
+
+    // Look up the first k-mer of s[0, len), and start loading the entries
+    // of its suffix array interval that the search reads first
+    void prefetchInterval(const char* s, size_t len) const {
+        uint64_t anchor{0};
+        if (!validK_() or !firstKmer_(s, len, anchor)) { return; }
+        auto it = sidx_->khash.find(anchor);
+        if (it == sidx_->khash.end()) { return; }
+        auto begin = it->second.begin;
+        auto end = it->second.end;
+        if (end <= begin) { return; }
+        const auto* sa = sidx_->SA.data();
+        __builtin_prefetch(sa + begin);
+        __builtin_prefetch(sa + begin + (end - begin) / 2);
+        __builtin_prefetch(sa + end - 1);
+    }
+
+  private:
+    using KmerHash = typename std::remove_reference<decltype(std::declval<IndexT&>().khash)>::type;
+    using Bucket = typename KmerHash::value_type;
+
+    bool validK_() const { return k_ > 0 and k_ <= 31; }
+
+    // The canonical value of the first k-mer of s without an N, which is
+    // the key under which the hit collector looks it up
+    bool firstKmer_(const char* s, size_t len, uint64_t& kmer) const {
+        return forEachCanonicalKmer(s, len, k_, [&kmer](uint64_t km) -> bool {
+                kmer = km;
+                return true;
+        });
+    }
+
+    /**
+     * Each of the first entries of the hash votes for the address at which
+     * the bucket array would start if the entry were in its home bucket;
+     * the address is used if most of them agree.
+     */
+    void findBuckets_() {
+        auto& khash = sidx_->khash;
+        size_t numBuckets = khash.bucket_count();
+        if (!validK_() or khash.empty() or (numBuckets & (numBuckets - 1)) != 0) { return; }
+        size_t mask = numBuckets - 1;
+        std::map<uintptr_t, size_t> votes;
+        size_t numVoters{0};
+        for (auto it = khash.begin(); it != khash.end() and numVoters < 64; ++it, ++numVoters) {
+            size_t home = khash.hash_funct()(it->first) & mask;
+            ++votes[reinterpret_cast<uintptr_t>(&*it) - home * sizeof(Bucket)];
+        }
+        for (auto& v : votes) {
+            if (2 * v.second > numVoters) {
+                buckets_ = v.first;
+                bucketMask_ = mask;
+            }
+        }
+    }
+
+    IndexT* sidx_;
+    uint32_t k_;
+    // The address of the hash's bucket array (0 if it isn't known)
+    uintptr_t buckets_{0};
+    size_t bucketMask_{0};
+};
+
+#endif // ANCHOR_PREFETCHER_HPP
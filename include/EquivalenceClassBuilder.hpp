@@ -1,6 +1,7 @@
 #ifndef EQUIVALENCE_CLASS_BUILDER_HPP
 #define EQUIVALENCE_CLASS_BUILDER_HPP
 
+#include <cstring>
 #include <unordered_map>
 #include <vector>
 #include <thread>
@@ -13,6 +14,7 @@
 #include "cuckoohash_map.hh"
 #include "concurrentqueue.h"
 #include "TranscriptGroup.hpp"
+#include "xxhash.h"
 
 
 struct TGValue {
@@ -24,6 +26,10 @@ struct TGValue {
     TGValue(std::vector<double>& weightIn, uint64_t countIn) :
         weights(weightIn) { count.store(countIn); }
 
+    // The weights of classes observed during mapping are all equal, so
+    // they aren't stored until EquivalenceClassBuilder::finish().
+    explicit TGValue(uint64_t countIn) { count.store(countIn); }
+
     // const is a lie
     void normalizeAux() const {
         double sumOfAux{0.0};
@@ -67,6 +73,9 @@ class EquivalenceClassBuilder {
             auto lt = countMap_.lock_table();
             for (auto& kv : lt) {
             //for (auto kv = countMap_.begin(); !kv.is_end(); ++kv) {
+                if (kv.second.weights.empty()) {
+                    kv.second.weights.assign(kv.first.txps.size(), 1.0);
+                }
                 kv.second.normalizeAux();
                 totalCount += kv.second.count;
                 countVec_.push_back(kv);
@@ -87,23 +96,13 @@ class EquivalenceClassBuilder {
             //countMap_.upsert(g, updatefn, v);
         }
 
-        inline void addGroup(TranscriptGroup&& g,
-                             std::vector<double>& weights) {
-
-            auto upfn = [&weights](TGValue& x) -> void {
-                // update the count
-                x.count++;
-                // update the weights
-                for (size_t i = 0; i < x.weights.size(); ++i) {
-                    // Possibly atomicized in the future
-                    weights[i] += x.weights[i];
-                    /* LOG SPACE
-                    x.weights[i] =
-                        salmon::math::logAdd(x.weights[i], weights[i]);
-                    */
-                }
-            };
-            TGValue v(weights, 1);
+        /**
+         * Add `count` observations of the group `g`.  The (uniform)
+         * weights of the group are filled in by finish().
+         */
+        inline void addGroup(TranscriptGroup&& g, uint64_t count = 1) {
+            auto upfn = [count](TGValue& x) -> void { x.count += count; };
+            TGValue v(count);
             countMap_.upsert(g, upfn, v);
         }
 
@@ -118,4 +117,110 @@ class EquivalenceClassBuilder {
     	std::shared_ptr<spdlog::logger> logger_;
 };
 
+/**
+ * Counts the equivalence classes observed by a single mapping thread.
+ * Most reads fall into a class the thread has already seen, so the counts
+ * are kept in a private (unsynchronized) table and merged into the shared
+ * EquivalenceClassBuilder in batches, rather than taking a lock in the
+ * shared map for every mapped read.  The remaining counts are merged
+ * when the accumulator is flushed or destroyed, which must happen before
+ * EquivalenceClassBuilder::finish() is called.
+ *
+ * Lookups hash the caller's transcript list in place.  The table is open
+ * addressed and labels of up to inlineTxps transcripts are stored inside
+ * the table entry (longer ones in a pool owned by the table), so counting
+ * a class that is already present does not allocate.
+ */
+class EquivalenceClassAccumulator {
+    public:
+        EquivalenceClassAccumulator(EquivalenceClassBuilder& builder,
+                                    size_t maxClasses = 16384) :
+            builder_(builder), maxClasses_(maxClasses) {
+            // Keep the load factor at or below 1/2
+            size_t capacity{1};
+            while (capacity < 2 * maxClasses_) { capacity <<= 1; }
+            table_.resize(capacity);
+            mask_ = capacity - 1;
+        }
+
+        ~EquivalenceClassAccumulator() { flush(); }
+
+        /**
+         * Count one observation of the class consisting of the (sorted)
+         * transcripts in `txps`.
+         */
+        inline void addGroup(const std::vector<uint32_t>& txps) {
+            uint32_t len = static_cast<uint32_t>(txps.size());
+            if (len == 0) { return; }
+            const uint32_t* ids = txps.data();
+            // Same hash as TranscriptGroup, so it needn't be recomputed on a merge
+            uint64_t hash = XXH64(static_cast<const void*>(ids), len * sizeof(uint32_t), 0);
+
+            size_t idx = hash & mask_;
+            while (table_[idx].len > 0) {
+                auto& e = table_[idx];
+                if (e.hash == hash and e.len == len and
+                    std::memcmp(label(e), ids, len * sizeof(uint32_t)) == 0) {
+                    ++e.count;
+                    return;
+                }
+                idx = (idx + 1) & mask_;
+            }
+
+            // A new class
+            auto& e = table_[idx];
+            e.hash = hash;
+            e.len = len;
+            e.count = 1;
+            if (len <= inlineTxps) {
+                std::memcpy(e.txps, ids, len * sizeof(uint32_t));
+            } else {
+                e.txps[0] = static_cast<uint32_t>(pool_.size());
+                pool_.insert(pool_.end(), ids, ids + len);
+            }
+            // Bound the size of the private table
+            if (++numClasses_ >= maxClasses_) { flush(); }
+        }
+
+        /**
+         * Merge all of the counts gathered so far into the shared builder.
+         */
+        void flush() {
+            if (numClasses_ == 0) { return; }
+            for (auto& e : table_) {
+                if (e.len == 0) { continue; }
+                const uint32_t* ids = label(e);
+                TranscriptGroup tg(std::vector<uint32_t>(ids, ids + e.len), e.hash);
+                builder_.addGroup(std::move(tg), e.count);
+                e.len = 0;
+            }
+            pool_.clear();
+            numClasses_ = 0;
+        }
+
+    private:
+        static constexpr uint32_t inlineTxps = 6;
+
+        struct Entry {
+            uint64_t hash{0};
+            uint64_t count{0};
+            // The number of transcripts in the label; 0 marks an empty slot.
+            uint32_t len{0};
+            // The label itself if len <= inlineTxps, otherwise txps[0] is
+            // the offset of the label in pool_.
+            uint32_t txps[inlineTxps];
+        };
+
+        inline const uint32_t* label(const Entry& e) const {
+            return (e.len <= inlineTxps) ? e.txps : pool_.data() + e.txps[0];
+        }
+
+        EquivalenceClassBuilder& builder_;
+        size_t maxClasses_;
+        size_t numClasses_{0};
+        size_t mask_{0};
+        std::vector<Entry> table_;
+        std::vector<uint32_t> pool_;
+};
+
 #endif // EQUIVALENCE_CLASS_BUILDER_HPP
@@ -0,0 +1,85 @@
+#ifndef KMER_BLOOM_FILTER_HPP
+#define KMER_BLOOM_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+/**
+ * A blocked Bloom filter over the (canonical) k-mers of the transcriptome,
+ * built along with the index and stored next to it.  Every k-mer sets a few
+ * bits within a single 64-byte block, so a query costs at most one cache
+ * miss.  A read none of whose k-mers are in the filter has no k-mer in the
+ * index either, and so can't map; since a Bloom filter has no false
+ * negatives, such reads can be rejected without searching the index.
+ * Since a read passes if any one of its k-mers is a false positive, the
+ * filter needs more bits per k-mer than usual: with 16, about 8% of
+ * random 100bp reads get through.
+ *
+ * On disk, the blocks follow a 64-byte header, so a loaded filter is
+ * simply mmap()ed: loading costs only page faults, and concurrent quant
+ * processes share one copy of the filter in the page cache.
+ */
+class KmerBloomFilter {
+  public:
+    // The name of the filter file in the index directory
+    static constexpr const char* fileName = "kmerFilter.bin";
+
+    KmerBloomFilter() {}
+
+    // An empty filter for about numKmers k-mers of length k (<= 31)
+    KmerBloomFilter(uint32_t k, uint64_t numKmers, uint32_t bitsPerKmer);
+
+    KmerBloomFilter(const KmerBloomFilter&) = delete;
+    KmerBloomFilter& operator=(const KmerBloomFilter&) = delete;
+
+    /**
+     * Add every k-mer of s[0, len) that contains only A, C, G and T.  Bits
+     * are set atomically, so several threads can add k-mers at once.
+     */
+    void addKmers(const char* s, size_t len);
+
+    // False only if no k-mer of s[0, len) was added to the filter
+    bool mayContainAnyKmer(const char* s, size_t len) const;
+
+    uint32_t k() const { return k_; }
+    size_t sizeInBytes() const { return numBlocks_ * blockWords * sizeof(uint64_t); }
+
+    // Write the filter to / map it from path; throw std::runtime_error on failure
+    void save(const std::string& path) const;
+    void load(const std::string& path);
+
+    // True if the filter was mapped from a file by load()
+    bool isMapped() const { return mapping_.isMapped(); }
+
+  private:
+    static constexpr size_t blockWords = 8;
+    // The header takes one block, so that the blocks of a mapped file are aligned
+    static constexpr size_t headerWords = blockWords;
+    static constexpr uint32_t bitsPerKey = 6;
+
+    void allocate_(uint64_t numBlocks);
+    void insert_(uint64_t kmer);
+    bool contains_(uint64_t kmer) const;
+
+    uint32_t k_{0};
+    uint64_t numBlocks_{0};
+    std::vector<uint64_t> storage_;
+    // The mapping of the filter file, if it was loaded
+    MappedFile mapping_;
+    // The first (cache line aligned) block, within storage_ or the mapping
+    uint64_t* blocks_{nullptr};
+};
+
+/**
+ * The DUST score of s[0, len): the number of pairs of identical
+ * trinucleotides, divided by the number of trinucleotides less one.
+ * Random sequence scores about 1, and homopolymers and short tandem
+ * repeats score 20 or more.
+ */
+double dustScore(const char* s, size_t len);
+
+#endif // KMER_BLOOM_FILTER_HPP
@@ -34,6 +34,13 @@ public:
              (static_cast<uint8_t>(ReadStrandedness::U)) << 3);
     }
 
+    // The formatID() of the library format (type, orientation, strandedness)
+    constexpr static uint8_t formatIDFor(ReadType t, ReadOrientation o, ReadStrandedness s) {
+        return (0x01 & static_cast<uint8_t>(t)) |
+               (0x3 & static_cast<uint8_t>(o)) << 1 |
+               (0x7 & static_cast<uint8_t>(s)) << 3;
+    }
+
     inline static LibraryFormat formatFromID(uint8_t id) {
         ReadType rt;
         ReadOrientation ro;
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A whole file mmap()ed into memory, and unmapped on destruction.  The
+ * mapping is private, so its pages are shared (through the page cache)
+ * with every other process that maps the file, while writes through it
+ * only change this process' copy.  Loading a file this way costs only
+ * page faults, for the pages that are actually used.
+ */
+class MappedFile {
+  public:
+    MappedFile() {}
+    // Throws std::runtime_error if path can't be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile() { reset(); }
+
+    MappedFile(MappedFile&& other);
+    MappedFile& operator=(MappedFile&& other);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isMapped() const { return data_ != nullptr; }
+
+    // Unmap the file (if it is mapped)
+    void reset();
+
+  private:
+    void* data_{nullptr};
+    size_t size_{0};
+};
+
+#endif // MAPPED_FILE_HPP
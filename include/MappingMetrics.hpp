@@ -0,0 +1,108 @@
+#ifndef MAPPING_METRICS_HPP
+#define MAPPING_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SailfishOpts.hpp"
+#include "ReadExperiment.hpp"
+
+/**
+ * The mapping statistics gathered by a single thread.  They are added to
+ * the (atomic) totals of the ReadExperiment by flush(), which the mapping
+ * threads call once per batch of reads rather than once per read.
+ */
+struct MappingCounters {
+    uint64_t numObservedFragments{0};
+    uint64_t numMappedFragments{0};
+    uint64_t numFragHits{0};
+    uint64_t upperBoundHits{0};
+    // Fragments discarded for having more than maxReadOccs mappings
+    uint64_t numTooManyHits{0};
+    // Right mates that weren't searched because the left mate had no hits
+    uint64_t numMateSearchesSkipped{0};
+    // Reads (or mates) rejected before the search: no k-mer in the
+    // index's k-mer filter, or too low in complexity
+    uint64_t numKmerFiltered{0};
+    uint64_t numLowComplexity{0};
+    int64_t numFwd{0};
+    int64_t numRC{0};
+    uint64_t numCacheLookups{0};
+    uint64_t numCacheHits{0};
+
+    void flush(ReadExperiment& readExp) {
+        readExp.numObservedFragmentsAtomic() += numObservedFragments;
+        readExp.numMappedFragmentsAtomic() += numMappedFragments;
+        readExp.numFragHitsAtomic() += numFragHits;
+        readExp.upperBoundHitsAtomic() += upperBoundHits;
+        readExp.numTooManyHitsAtomic() += numTooManyHits;
+        readExp.numMateSearchesSkippedAtomic() += numMateSearchesSkipped;
+        readExp.numKmerFilteredAtomic() += numKmerFiltered;
+        readExp.numLowComplexityAtomic() += numLowComplexity;
+        readExp.addNumFwd(numFwd);
+        readExp.addNumRC(numRC);
+        readExp.numReadCacheLookupsAtomic() += numCacheLookups;
+        readExp.numReadCacheHitsAtomic() += numCacheHits;
+        *this = MappingCounters();
+    }
+};
+
+/**
+ * Reports the progress of the mapping phase from a background thread, so
+ * that the mapping threads only have to flush their MappingCounters.  The
+ * progress line is printed to stderr every 500,000 fragments, as before,
+ * and if SailfishOpts::metricsFile is set, a JSON snapshot of the
+ * throughput, mapping rate, hits per fragment and the depth of each parsed
+ * read queue is (atomically) rewritten every metricsInterval seconds.
+ */
+class MappingMetricsReporter {
+  public:
+    MappingMetricsReporter(ReadExperiment& readExp,
+                           const SailfishOpts& sfOpts,
+                           std::mutex& iomutex);
+
+    ~MappingMetricsReporter();
+
+    /**
+     * Report the queue called `name`; `depth` must return the number of
+     * parsed batches that are waiting to be mapped.
+     */
+    void addQueue(const std::string& name, std::function<int64_t()> depth);
+
+    void start();
+
+    /**
+     * Stop reporting; the metrics file (if any) is written a final time.
+     */
+    void stop();
+
+  private:
+    void run_();
+    void writeMetrics_(bool done);
+
+    ReadExperiment& readExp_;
+    const SailfishOpts& sfOpts_;
+    std::mutex& iomutex_;
+
+    std::vector<std::string> queueNames_;
+    std::vector<std::function<int64_t()>> queueDepths_;
+
+    std::thread thread_;
+    std::mutex stopMutex_;
+    std::condition_variable stopCond_;
+    bool stop_{false};
+    bool running_{false};
+
+    std::chrono::steady_clock::time_point startTime_;
+    std::chrono::steady_clock::time_point lastWriteTime_;
+    uint64_t lastWriteFragments_{0};
+};
+
+#endif // MAPPING_METRICS_HPP
@@ -0,0 +1,139 @@
+#ifndef PACKED_SEQUENCE_HPP
+#define PACKED_SEQUENCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SailfishUtils.hpp"
+#include "MappedFile.hpp"
+
+/**
+ * A nucleotide sequence stored with 2 bits per base (32 bases per word,
+ * the first in the low bits), along with the runs of characters other
+ * than A, C, G and T.  These are stored with the code of 'A', and are
+ * read back as 'N'.
+ *
+ * In memory, the sequence is laid out as on disk (a header, the runs of
+ * Ns, then the bases), so a loaded sequence is simply mmap()ed.  The
+ * packed transcriptome stored with the index is a quarter the size of the
+ * quasi-index's text, but is kept in addition to it (the mapping searches
+ * the text), for the passes that only need to scan the sequence.
+ */
+class PackedSequence {
+public:
+    // The name of the packed transcriptome in the index directory
+    static constexpr const char* fileName = "packedTranscriptome.bin";
+
+    PackedSequence() = default;
+    PackedSequence(const char* s, size_t len);
+
+    PackedSequence(PackedSequence&&) = default;
+    PackedSequence& operator=(PackedSequence&&) = default;
+    PackedSequence(const PackedSequence&) = delete;
+    PackedSequence& operator=(const PackedSequence&) = delete;
+
+    size_t size() const { return size_; }
+
+    // The 2-bit code (A = 0, C = 1, G = 2, T = 3) of base i; 0 for an N
+    uint32_t code(size_t i) const {
+        return (words_[i >> 5] >> ((i & 0x1f) << 1)) & 0x3;
+    }
+
+    // True if there is an N in [start, start + len)
+    bool hasN(size_t start, size_t len) const;
+    bool isN(size_t i) const { return hasN(i, 1); }
+
+    char operator[](size_t i) const { return isN(i) ? 'N' : "ACGT"[code(i)]; }
+
+    // The bases [start, start + len), as characters
+    std::string decode(size_t start, size_t len) const;
+
+    // The number of Gs and Cs in [start, start + len)
+    size_t gcCount(size_t start, size_t len) const;
+
+    /**
+     * The index (as given by indexForKmer) of the K-mer starting at base
+     * i, or the max uint32_t if it contains an N.
+     */
+    uint32_t kmerIndex(size_t i, uint32_t K, sailfish::utils::Direction dir) const;
+
+    /**
+     * As kmerIndices, for the numKmers K-mers starting at bases start,
+     * start + 1, ...; Ns are treated as 'A' in either direction.
+     */
+    void kmerIndices(size_t start, size_t numKmers, uint32_t K,
+                     sailfish::utils::Direction dir,
+                     std::vector<uint32_t>& idx,
+                     std::vector<uint32_t>& codes) const;
+
+    void save(const std::string& path) const;
+    // Map the sequence from path; throws std::runtime_error if the file is
+    // missing or invalid
+    void load(const std::string& path);
+
+    // True if the sequence was mapped from a file by load()
+    bool isMapped() const { return mapping_.isMapped(); }
+
+    size_t sizeInBytes() const { return numWords_ * sizeof(uint64_t); }
+
+private:
+    static constexpr size_t headerWords = 4;
+
+    // Point size_, runs_ and words_ into the layout starting at data
+    void setLayout_(const uint64_t* data);
+    // The index of the first run of Ns that ends after base i
+    size_t firstRunAfter_(size_t i) const;
+    uint64_t runStart_(size_t r) const { return runs_[2 * r]; }
+    uint64_t runEnd_(size_t r) const { return runs_[2 * r] + runs_[2 * r + 1]; }
+
+    uint64_t size_{0};
+    // The number of runs of Ns, and of words in the whole layout
+    uint64_t numRuns_{0};
+    uint64_t numWords_{0};
+    // The (start, length) of each run of Ns, in order
+    const uint64_t* runs_{nullptr};
+    const uint64_t* words_{nullptr};
+    // The layout of a sequence built in memory, or the mapping of a loaded one
+    std::vector<uint64_t> storage_;
+    MappedFile mapping_;
+};
+
+/**
+ * The bases [offset, offset + length) of a PackedSequence (e.g. one
+ * transcript of the packed transcriptome); positions are relative to
+ * offset.
+ */
+class PackedSequenceView {
+public:
+    PackedSequenceView() = default;
+    PackedSequenceView(const PackedSequence* seq, uint64_t offset, uint64_t len) :
+        seq_(seq), offset_(offset), len_(len) {}
+
+    size_t size() const { return len_; }
+    uint32_t code(size_t i) const { return seq_->code(offset_ + i); }
+    char operator[](size_t i) const { return (*seq_)[offset_ + i]; }
+    std::string str() const { return seq_->decode(offset_, len_); }
+
+    size_t gcCount(size_t start, size_t len) const {
+        return seq_->gcCount(offset_ + start, len);
+    }
+
+    uint32_t kmerIndex(size_t i, uint32_t K, sailfish::utils::Direction dir) const {
+        return seq_->kmerIndex(offset_ + i, K, dir);
+    }
+
+    void kmerIndices(size_t numKmers, uint32_t K, sailfish::utils::Direction dir,
+                     std::vector<uint32_t>& idx, std::vector<uint32_t>& codes) const {
+        seq_->kmerIndices(offset_, numKmers, K, dir, idx, codes);
+    }
+
+private:
+    const PackedSequence* seq_{nullptr};
+    uint64_t offset_{0};
+    uint64_t len_{0};
+};
+
+#endif // PACKED_SEQUENCE_HPP
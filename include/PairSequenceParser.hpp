@@ -7,12 +7,18 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <fstream>
 
 #include <jellyfish/err.hpp>
 #include <jellyfish/cooperative_pool2.hpp>
 #include <jellyfish/cpp_array.hpp>
 
+#include "ReadBatch.hpp"
+#include "ReadStream.hpp"
+
+// NOTE: These are no longer produced by the parsers in this file (see
+// ReadBatch.hpp), but RapMap's utilities still refer to them.
 struct header_sequence_qual {
   std::string header;
   std::string seq;
@@ -24,38 +30,64 @@ struct sequence_list {
 };
 
 template<typename PathIterator>
-class pair_sequence_parser : public jellyfish::cooperative_pool2<pair_sequence_parser<PathIterator>, sequence_list> {
-  typedef jellyfish::cooperative_pool2<pair_sequence_parser<PathIterator>, sequence_list> super;
+class pair_sequence_parser : public jellyfish::cooperative_pool2<pair_sequence_parser<PathIterator>, paired_read_batch> {
+  typedef jellyfish::cooperative_pool2<pair_sequence_parser<PathIterator>, paired_read_batch> super;
   typedef std::unique_ptr<std::istream> stream_type;
+  typedef std::unique_ptr<fastx_line_reader> reader_type;
   enum file_type { DONE_TYPE, FASTA_TYPE, FASTQ_TYPE, ERROR_TYPE };
 
   struct stream_status {
     file_type   type;
-    std::string buffer;
     stream_type stream1;
     stream_type stream2;
+    reader_type reader1;
+    reader_type reader2;
 
     stream_status() : type(DONE_TYPE) { }
   };
   jellyfish::cpp_array<stream_status> streams_;
   PathIterator                        path_begin_, path_end_;
   std::mutex                          path_mutex_;
+  uint32_t                            decomp_threads_;
+  bool                                keep_headers_;
+  bool                                keep_quals_;
+  std::atomic<uint64_t>               nb_produced_;
+  std::atomic<uint64_t>               nb_consumed_;
+  bool                                interleaved_;
 
 public:
   /// Size is the number of buffers to keep around. It should be
   /// larger than the number of thread expected to read from this
   /// class. nb_sequences is the number of sequences to read into a
   /// buffer. 'begin' and 'end' are iterators to a range of istream.
+  /// Gzipped (and BGZF) files are decompressed transparently, using
+  /// up to decomp_threads threads per open file.  Read headers and
+  /// quality values are only stored if keep_headers / keep_quals are set.
+  ///
+  /// Normally the paths alternate between #1 and #2 mate files.  If
+  /// interleaved is true, each path is instead a single file in which
+  /// the two mates of a pair are consecutive records, so paired reads
+  /// can be streamed through one pipe (a path of "-" reads stdin).
   pair_sequence_parser(uint32_t size, uint32_t nb_sequences,
                        uint32_t max_producers,
-                       PathIterator path_begin, PathIterator path_end) :
+                       PathIterator path_begin, PathIterator path_end,
+                       uint32_t decomp_threads = 1,
+                       bool keep_headers = false, bool keep_quals = false,
+                       bool interleaved = false) :
     super(max_producers, size),
     streams_(max_producers),
-    path_begin_(path_begin), path_end_(path_end)
+    path_begin_(path_begin), path_end_(path_end),
+    decomp_threads_(decomp_threads),
+    keep_headers_(keep_headers), keep_quals_(keep_quals),
+    nb_produced_(0), nb_consumed_(0),
+    interleaved_(interleaved)
   {
     for(auto it = super::element_begin(); it != super::element_end(); ++it) {
       it->nb_filled = 0;
       it->data.resize(nb_sequences);
+      // A guess at the space needed for a batch of ~100bp pairs; the
+      // arena grows as necessary and keeps its capacity between uses.
+      it->arena.reserve(nb_sequences * 256);
     }
     for(uint32_t i = 0; i < max_producers; ++i) {
       streams_.init(i);
@@ -63,7 +95,7 @@ public:
     }
   }
 
-  inline bool produce(uint32_t i, sequence_list& buff) {
+  inline bool produce(uint32_t i, paired_read_batch& buff) {
     stream_status& st = streams_[i];
 
     switch(st.type) {
@@ -77,8 +109,9 @@ public:
     case ERROR_TYPE:
       return true;
     }
+    ++nb_produced_;
 
-    if(st.stream1->good() && st.stream2->good())
+    if(st.reader1->good() && (!st.reader2 || st.reader2->good()))
       return false;
 
     // Reach the end of file, close current and try to open the next one
@@ -86,9 +119,16 @@ public:
     return false;
   }
 
+  /// The number of batches filled so far, and the number that consumers
+  /// have reported taking with batch_consumed().  The difference is the
+  /// (approximate) number of parsed batches waiting to be processed.
+  uint64_t batches_produced() const { return nb_produced_; }
+  uint64_t batches_consumed() const { return nb_consumed_; }
+  void batch_consumed() { ++nb_consumed_; }
+
 protected:
-  file_type peek_file_type(std::istream& is) {
-    switch(is.peek()) {
+  file_type peek_file_type(fastx_line_reader& lr) {
+    switch(lr.peek()) {
     case EOF: return DONE_TYPE;
     case '>': return FASTA_TYPE;
     case '@': return FASTQ_TYPE;
@@ -97,6 +137,8 @@ protected:
   }
 
   void open_next_files(stream_status& st) {
+    st.reader1.reset();
+    st.reader2.reset();
     st.stream1.reset();
     st.stream2.reset();
     const char *p1 = 0, *p2 = 0;
@@ -106,27 +148,48 @@ protected:
         p1 = *path_begin_;
         ++path_begin_;
       }
-      if(path_begin_ < path_end_) {
+      if(!interleaved_ && path_begin_ < path_end_) {
         p2 = *path_begin_;
         ++path_begin_;
       }
     }
 
+    if(interleaved_) {
+      if(!p1) {
+        st.type = DONE_TYPE;
+        return;
+      }
+      st.stream1 = sailfish::io::openReadStream(p1, decomp_threads_);
+      if(!*st.stream1) {
+        st.type = DONE_TYPE;
+        return;
+      }
+      st.reader1.reset(new fastx_line_reader(*st.stream1));
+      file_type type = peek_file_type(*st.reader1);
+      if(type == DONE_TYPE)
+        return open_next_files(st);
+      if(type == ERROR_TYPE)
+        throw std::runtime_error("Unsupported format");
+      st.type = type;
+      return;
+    }
+
     if(!p1 || !p2) {
       st.type = DONE_TYPE;
       return;
     }
-    st.stream1.reset(new std::ifstream(p1));
-    st.stream2.reset(new std::ifstream(p2));
+    st.stream1 = sailfish::io::openReadStream(p1, decomp_threads_);
+    st.stream2 = sailfish::io::openReadStream(p2, decomp_threads_);
     if(!*st.stream1 || !*st.stream2) {
       st.type = DONE_TYPE;
       return;
     }
+    st.reader1.reset(new fastx_line_reader(*st.stream1));
+    st.reader2.reset(new fastx_line_reader(*st.stream2));
 
-    // Update the type of the current file and move past first header
-    // to beginning of sequence.
-    file_type type1 = peek_file_type(*st.stream1);
-    file_type type2 = peek_file_type(*st.stream2);
+    // Update the type of the current file
+    file_type type1 = peek_file_type(*st.reader1);
+    file_type type2 = peek_file_type(*st.reader2);
     if(type1 == DONE_TYPE || type2 == DONE_TYPE)
       return open_next_files(st);
     if(type1 != type2)
@@ -136,56 +199,43 @@ protected:
     st.type = type1;
   }
 
-  void read_fasta_one_sequence(std::istream& is, std::string& tmp, header_sequence_qual& hsq) {
-    is.get(); // Skip '>'
-    std::getline(is, hsq.header);
-    hsq.seq.clear();
-    while(is.peek() != '>' && is.peek() != EOF) {
-      std::getline(is, tmp); // Wish there was an easy way to combine the
-      hsq.seq.append(tmp);             // two lines avoiding copying
-    }
-  }
-
-  void read_fasta(stream_status& st, sequence_list& buff) {
+  void read_fasta(stream_status& st, paired_read_batch& buff) {
     size_t&      nb_filled = buff.nb_filled;
     const size_t data_size = buff.data.size();
 
-    for(nb_filled = 0; nb_filled < data_size && st.stream1->peek() != EOF && st.stream2->peek() != EOF; ++nb_filled) {
-      read_fasta_one_sequence(*st.stream1, st.buffer, buff.data[nb_filled].first);
-      read_fasta_one_sequence(*st.stream2, st.buffer, buff.data[nb_filled].second);
-    }
-  }
-
-  void read_fastq_one_sequence(std::istream& is, std::string& tmp, header_sequence_qual& hsq) {
-    is.get(); // Skip '@'
-    std::getline(is, hsq.header);
-    hsq.seq.clear();
-    while(is.peek() != '+' && is.peek() != EOF) {
-      std::getline(is, tmp); // Wish there was an easy way to combine the
-      hsq.seq.append(tmp);             // two lines avoiding copying
+    buff.arena.clear();
+    if(interleaved_) {
+      for(nb_filled = 0; nb_filled < data_size && st.reader1->peek() != EOF; ++nb_filled) {
+        read_fasta_record(*st.reader1, buff, buff.data[nb_filled].first, keep_headers_);
+        if(st.reader1->peek() == EOF)
+          throw std::runtime_error("Interleaved file has an unpaired last read");
+        read_fasta_record(*st.reader1, buff, buff.data[nb_filled].second, keep_headers_);
+      }
+      return;
     }
-    if(!is.good())
-      throw std::runtime_error("Truncated fastq file");
-    is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-    hsq.qual.clear();
-    while(hsq.qual.size() < hsq.seq.size() && is.good()) {
-      std::getline(is, tmp);
-      hsq.qual.append(tmp);
+    for(nb_filled = 0; nb_filled < data_size && st.reader1->peek() != EOF && st.reader2->peek() != EOF; ++nb_filled) {
+      read_fasta_record(*st.reader1, buff, buff.data[nb_filled].first, keep_headers_);
+      read_fasta_record(*st.reader2, buff, buff.data[nb_filled].second, keep_headers_);
     }
-    if(hsq.qual.size() != hsq.seq.size())
-      throw std::runtime_error("Invalid fastq file: wrong number of quals");
-    if(is.peek() != EOF && is.peek() != '@')
-      throw std::runtime_error("Invalid fastq file: header missing");
-
   }
 
-  void read_fastq(stream_status& st, sequence_list& buff) {
+  void read_fastq(stream_status& st, paired_read_batch& buff) {
     size_t&      nb_filled = buff.nb_filled;
     const size_t data_size = buff.data.size();
 
-    for(nb_filled = 0; nb_filled < data_size && st.stream1->peek() != EOF && st.stream2->peek() != EOF; ++nb_filled) {
-      read_fastq_one_sequence(*st.stream1, st.buffer, buff.data[nb_filled].first);
-      read_fastq_one_sequence(*st.stream2, st.buffer, buff.data[nb_filled].second);
+    buff.arena.clear();
+    if(interleaved_) {
+      for(nb_filled = 0; nb_filled < data_size && st.reader1->peek() != EOF; ++nb_filled) {
+        read_fastq_record(*st.reader1, buff, buff.data[nb_filled].first, keep_headers_, keep_quals_);
+        if(st.reader1->peek() == EOF)
+          throw std::runtime_error("Interleaved file has an unpaired last read");
+        read_fastq_record(*st.reader1, buff, buff.data[nb_filled].second, keep_headers_, keep_quals_);
+      }
+      return;
+    }
+    for(nb_filled = 0; nb_filled < data_size && st.reader1->peek() != EOF && st.reader2->peek() != EOF; ++nb_filled) {
+      read_fastq_record(*st.reader1, buff, buff.data[nb_filled].first, keep_headers_, keep_quals_);
+      read_fastq_record(*st.reader2, buff, buff.data[nb_filled].second, keep_headers_, keep_quals_);
     }
   }
 };
@@ -0,0 +1,180 @@
+#ifndef __READ_BATCH_HPP__
+#define __READ_BATCH_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A single FASTA/FASTQ record inside of a read_batch.  The fields are
+/// (offset, length) pairs into the batch's arena.  The header and quality
+/// strings are only copied into the arena if the parser was asked to keep
+/// them; otherwise their length is 0.
+struct read_record {
+  uint32_t seq_off{0};
+  uint32_t seq_len{0};
+  uint32_t header_off{0};
+  uint32_t header_len{0};
+  uint32_t qual_off{0};
+  uint32_t qual_len{0};
+};
+
+/// A batch of reads (or read pairs) produced by one parser job.  All of the
+/// bytes for the batch live in one contiguous arena, which is reused (along
+/// with its capacity) each time the batch is refilled.
+template <typename RecordT>
+struct read_batch {
+  size_t            nb_filled{0};
+  std::vector<char> arena;
+  std::vector<RecordT> data;
+
+  inline const char* bytes(uint32_t off) const { return arena.data() + off; }
+
+  inline uint32_t append(const char* p, size_t len) {
+    uint32_t off = static_cast<uint32_t>(arena.size());
+    arena.insert(arena.end(), p, p + len);
+    return off;
+  }
+};
+
+typedef read_batch<read_record>                            single_read_batch;
+typedef read_batch<std::pair<read_record, read_record> >   paired_read_batch;
+
+/// Buffered line reader used by the parsers.  Data is pulled from the
+/// underlying stream in large blocks and record boundaries are located with
+/// memchr (which glibc implements with SIMD), so there is no per-character
+/// stream overhead and no intermediate std::string per line.
+class fastx_line_reader {
+public:
+  explicit fastx_line_reader(std::istream& is, size_t buffer_size = 1 << 20) :
+    is_(is), buf_(buffer_size), pos_(0), end_(0), eof_(false) { }
+
+  /// Returns the next character without consuming it, or EOF.
+  inline int peek() {
+    if(pos_ == end_ && !fill())
+      return EOF;
+    return static_cast<unsigned char>(buf_[pos_]);
+  }
+
+  /// Sets [line, line + len) to the next line (without the line terminator).
+  /// The pointer is only valid until the next call on this reader.  Returns
+  /// false at the end of the input.
+  inline bool next_line(const char*& line, size_t& len) {
+    while(true) {
+      const char* start = buf_.data() + pos_;
+      const char* nl = static_cast<const char*>(std::memchr(start, '\n', end_ - pos_));
+      if(nl) {
+        line = start;
+        len  = nl - start;
+        pos_ += len + 1;
+        if(len > 0 && line[len - 1] == '\r') --len;
+        return true;
+      }
+      if(eof_) {
+        if(pos_ == end_) return false;
+        // Last line without a trailing newline
+        line = start;
+        len  = end_ - pos_;
+        pos_ = end_;
+        if(len > 0 && line[len - 1] == '\r') --len;
+        return true;
+      }
+      fill();
+    }
+  }
+
+  /// Returns true if there may be more input.
+  inline bool good() { return peek() != EOF; }
+
+private:
+  /// Move any partial line to the front of the buffer and read more data
+  /// after it.  Returns false if no more data could be read.
+  bool fill() {
+    if(eof_) return false;
+    size_t rem = end_ - pos_;
+    if(pos_ > 0) {
+      std::memmove(buf_.data(), buf_.data() + pos_, rem);
+      pos_ = 0;
+      end_ = rem;
+    }
+    // A single line that doesn't fit in the buffer; grow it.
+    if(end_ == buf_.size())
+      buf_.resize(2 * buf_.size());
+    is_.read(buf_.data() + end_, buf_.size() - end_);
+    size_t n = static_cast<size_t>(is_.gcount());
+    end_ += n;
+    if(n == 0 || !is_.good())
+      eof_ = true;
+    return n > 0;
+  }
+
+  std::istream&     is_;
+  std::vector<char> buf_;
+  size_t            pos_;
+  size_t            end_;
+  bool              eof_;
+};
+
+/// Parse the next FASTA record from lr into rec, appending the sequence (and
+/// optionally the header) to the arena of batch.
+template <typename BatchT>
+inline void read_fasta_record(fastx_line_reader& lr, BatchT& batch, read_record& rec,
+                              bool keep_header) {
+  const char* line;
+  size_t      len;
+  lr.next_line(line, len);
+  rec.header_len = 0;
+  if(keep_header && len > 0) {
+    rec.header_off = batch.append(line + 1, len - 1); // Skip '>'
+    rec.header_len = len - 1;
+  }
+  rec.seq_off = static_cast<uint32_t>(batch.arena.size());
+  while(lr.peek() != '>' && lr.peek() != EOF) {
+    lr.next_line(line, len);
+    batch.append(line, len);
+  }
+  rec.seq_len = static_cast<uint32_t>(batch.arena.size()) - rec.seq_off;
+  rec.qual_len = 0;
+}
+
+/// Parse the next FASTQ record from lr into rec, appending the sequence (and
+/// optionally the header and quality values) to the arena of batch.
+template <typename BatchT>
+inline void read_fastq_record(fastx_line_reader& lr, BatchT& batch, read_record& rec,
+                              bool keep_header, bool keep_qual) {
+  const char* line;
+  size_t      len;
+  lr.next_line(line, len);
+  rec.header_len = 0;
+  if(keep_header && len > 0) {
+    rec.header_off = batch.append(line + 1, len - 1); // Skip '@'
+    rec.header_len = len - 1;
+  }
+  rec.seq_off = static_cast<uint32_t>(batch.arena.size());
+  while(lr.peek() != '+' && lr.peek() != EOF) {
+    lr.next_line(line, len);
+    batch.append(line, len);
+  }
+  rec.seq_len = static_cast<uint32_t>(batch.arena.size()) - rec.seq_off;
+  if(lr.peek() == EOF)
+    throw std::runtime_error("Truncated fastq file");
+  lr.next_line(line, len); // Skip the '+' line
+
+  size_t qual_len = 0;
+  rec.qual_off = static_cast<uint32_t>(batch.arena.size());
+  while(qual_len < rec.seq_len && lr.next_line(line, len)) {
+    if(keep_qual) batch.append(line, len);
+    qual_len += len;
+  }
+  if(qual_len != rec.seq_len)
+    throw std::runtime_error("Invalid fastq file: wrong number of quals");
+  rec.qual_len = keep_qual ? static_cast<uint32_t>(qual_len) : 0;
+  if(lr.peek() != EOF && lr.peek() != '@')
+    throw std::runtime_error("Invalid fastq file: header missing");
+}
+
+#endif /* __READ_BATCH_HPP__ */
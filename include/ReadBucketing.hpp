@@ -0,0 +1,88 @@
+#ifndef READ_BUCKETING_HPP
+#define READ_BUCKETING_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "ReadBatch.hpp"
+#include "UtilityFunctions.hpp"
+
+/**
+ * Chooses the order in which the reads of a batch are mapped, so that
+ * reads that share a minimizer (and so, most likely, come from the same
+ * place in the transcriptome) are mapped one after another and walk the
+ * same parts of the index.  Each read's minimizer is the canonical m-mer
+ * with the smallest hash; the reads are then sorted by the sequence of
+ * that m-mer, so that consecutive buckets also touch nearby parts of the
+ * (lexicographically ordered) suffix array.  Each mapping thread has its
+ * own ReadBucketer; the buffers are reused from batch to batch.
+ */
+class ReadBucketer {
+  public:
+    explicit ReadBucketer(uint32_t m = 15) : m_(m) {}
+
+    // The value of the minimizer of s[0, len), or the max. value if
+    // the sequence has no m-mer without an 'N'
+    uint64_t minimizer(const char* s, size_t len) const {
+        uint64_t best{noMinimizer};
+        uint64_t bestHash{std::numeric_limits<uint64_t>::max()};
+        forEachCanonicalKmer(s, len, m_, [&best, &bestHash](uint64_t mmer) -> bool {
+                uint64_t h = hash_(mmer);
+                if (h < bestHash) {
+                    bestHash = h;
+                    best = mmer;
+                }
+                return false;
+        });
+        return best;
+    }
+
+    // The order in which to map the reads of batch
+    const std::vector<uint32_t>& order(const single_read_batch& batch) {
+        keys_.resize(batch.nb_filled);
+        for (size_t i = 0; i < batch.nb_filled; ++i) {
+            auto& rec = batch.data[i];
+            keys_[i] = std::make_pair(minimizer(batch.bytes(rec.seq_off), rec.seq_len),
+                                      static_cast<uint32_t>(i));
+        }
+        return sortKeys_();
+    }
+
+    // For a pair, the smaller of the minimizers of the two mates is used
+    const std::vector<uint32_t>& order(const paired_read_batch& batch) {
+        keys_.resize(batch.nb_filled);
+        for (size_t i = 0; i < batch.nb_filled; ++i) {
+            auto& left = batch.data[i].first;
+            auto& right = batch.data[i].second;
+            uint64_t lm = minimizer(batch.bytes(left.seq_off), left.seq_len);
+            uint64_t rm = minimizer(batch.bytes(right.seq_off), right.seq_len);
+            uint64_t key = (lm == noMinimizer or (rm != noMinimizer and hash_(rm) < hash_(lm))) ? rm : lm;
+            keys_[i] = std::make_pair(key, static_cast<uint32_t>(i));
+        }
+        return sortKeys_();
+    }
+
+    static constexpr uint64_t noMinimizer = std::numeric_limits<uint64_t>::max();
+
+  private:
+    static inline uint64_t hash_(uint64_t x) {
+        x *= 0x9e3779b97f4a7c15ULL;
+        return x ^ (x >> 29);
+    }
+
+    const std::vector<uint32_t>& sortKeys_() {
+        std::sort(keys_.begin(), keys_.end());
+        order_.resize(keys_.size());
+        for (size_t i = 0; i < keys_.size(); ++i) { order_[i] = keys_[i].second; }
+        return order_;
+    }
+
+    uint32_t m_;
+    std::vector<std::pair<uint64_t, uint32_t>> keys_;
+    std::vector<uint32_t> order_;
+};
+
+#endif // READ_BUCKETING_HPP
@@ -36,9 +36,14 @@ class ReadExperiment {
 
     public:
 
+    /**
+     * If index is given (by `sailfish serve`), it must have been loaded
+     * from indexDirectory, and is used rather than loading the index again.
+     */
     ReadExperiment(std::vector<ReadLibrary>& readLibraries,
                    const boost::filesystem::path& indexDirectory,
-		           SailfishOpts& sopt) :
+		           SailfishOpts& sopt,
+                   std::shared_ptr<SailfishIndex> index = nullptr) :
         readLibraries_(readLibraries),
         transcripts_(std::vector<Transcript>()),
     	eqBuilder_(sopt.jointLog),
@@ -57,8 +62,12 @@ class ReadExperiment {
             size_t meanFragLen = sopt.fragLenDistPriorMean;
             size_t fragLenStd = sopt.fragLenDistPriorSD;
 
-            sfIndex_.reset(new SailfishIndex(sopt.jointLog));
-            sfIndex_->load(indexDirectory);
+            if (index) {
+                sfIndex_ = index;
+            } else {
+                sfIndex_.reset(new SailfishIndex(sopt.jointLog));
+                sfIndex_->load(indexDirectory);
+            }
             loadTranscriptsFromQuasi(sopt);
         }
 
@@ -79,6 +88,22 @@ class ReadExperiment {
     std::atomic<uint64_t>& upperBoundHitsAtomic() { return upperBoundHits_; }
     void setUpperBoundHits(uint64_t ubh) { upperBoundHits_.store(ubh); }
 
+    // The number of fragments discarded for mapping to > maxReadOccs places
+    uint64_t numTooManyHits() const { return numTooManyHits_; }
+    std::atomic<uint64_t>& numTooManyHitsAtomic() { return numTooManyHits_; }
+
+    // The number of mates that weren't searched since their partner had no hits
+    uint64_t numMateSearchesSkipped() const { return numMateSearchesSkipped_; }
+    std::atomic<uint64_t>& numMateSearchesSkippedAtomic() { return numMateSearchesSkipped_; }
+
+    // The number of reads (or mates) with no k-mer in the index's k-mer filter
+    uint64_t numKmerFiltered() const { return numKmerFiltered_; }
+    std::atomic<uint64_t>& numKmerFilteredAtomic() { return numKmerFiltered_; }
+
+    // The number of reads (or mates) rejected as low-complexity
+    uint64_t numLowComplexity() const { return numLowComplexity_; }
+    std::atomic<uint64_t>& numLowComplexityAtomic() { return numLowComplexity_; }
+
     uint64_t numObservedFragments() const { return numObservedFragments_; }
     std::atomic<uint64_t>& numObservedFragmentsAtomic() { return numObservedFragments_; }
 
@@ -90,12 +115,18 @@ class ReadExperiment {
         return static_cast<double>(numMappedFragments_) / numObservedFragments_;
     }
 
-    void addNumFwd(int32_t numMappings) { numFwd_ += numMappings; }
-    void addNumRC(int32_t numMappings) { numRC_ += numMappings; }
+    void addNumFwd(int64_t numMappings) { numFwd_ += numMappings; }
+    void addNumRC(int64_t numMappings) { numRC_ += numMappings; }
 
     int64_t numFwd() const { return numFwd_.load(); }
     int64_t numRC() const { return numRC_.load(); }
 
+    // Lookups in (and hits of) the duplicate read cache (--readCacheSize)
+    uint64_t numReadCacheLookups() const { return numReadCacheLookups_; }
+    std::atomic<uint64_t>& numReadCacheLookupsAtomic() { return numReadCacheLookups_; }
+    uint64_t numReadCacheHits() const { return numReadCacheHits_; }
+    std::atomic<uint64_t>& numReadCacheHitsAtomic() { return numReadCacheHits_; }
+
     SailfishIndex* getIndex() { return sfIndex_.get(); }
 
     template <typename IndexT>
@@ -111,9 +142,12 @@ class ReadExperiment {
             // copy over the length, then we're done.
             transcripts_.emplace_back(id, name, len);
             auto& txp = transcripts_.back();
-            // The transcript sequence
-            txp.setSequence(idx_->seq.c_str() + idx_->txpOffsets[i],
-                            sopt.gcBiasCorrect, sopt.gcSampFactor);
+            // The transcript sequence, which only the bias passes use
+            if (sopt.biasCorrect or sopt.gcBiasCorrect) {
+                txp.setSequence(PackedSequenceView(sfIndex_->packedTranscriptome(),
+                                                   idx_->txpOffsets[i], len),
+                                sopt.gcBiasCorrect, sopt.gcSampFactor);
+            }
         }
         // ====== Done loading the transcripts from file
         fmt::print(stderr, "Loaded targets\n");
@@ -226,7 +260,7 @@ class ReadExperiment {
     /**
      * The index we've built on the set of transcripts.
      */
-    std::unique_ptr<SailfishIndex> sfIndex_{nullptr};
+    std::shared_ptr<SailfishIndex> sfIndex_{nullptr};
 
     //SequenceBiasModel seqBiasModel_;
 
@@ -237,8 +271,14 @@ class ReadExperiment {
     std::atomic<uint64_t> numMappedFragments_{0};
     std::atomic<uint64_t> numFragHits_{0};
     std::atomic<uint64_t> upperBoundHits_{0};
+    std::atomic<uint64_t> numTooManyHits_{0};
+    std::atomic<uint64_t> numMateSearchesSkipped_{0};
+    std::atomic<uint64_t> numKmerFiltered_{0};
+    std::atomic<uint64_t> numLowComplexity_{0};
     std::atomic<int64_t> numFwd_{0};
     std::atomic<int64_t> numRC_{0};
+    std::atomic<uint64_t> numReadCacheLookups_{0};
+    std::atomic<uint64_t> numReadCacheHits_{0};
     double effectiveMappingRate_{0.0};
     //std::unique_ptr<FragmentLengthDistribution> fragLengthDist_;
     EquivalenceClassBuilder eqBuilder_;
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include "UtilityFunctions.hpp"
 #include "SailfishUtils.hpp"
+#include "PackedSequence.hpp"
 
 template <uint32_t K, typename CountT = uint32_t>
 class ReadKmerDist {
@@ -24,30 +25,40 @@ class ReadKmerDist {
 
     inline constexpr uint32_t getK() { return K; }
 
+    // Add the counts observed in other (i.e. without its pseudo-counts)
+    // to this distribution; used to merge per-thread distributions.
+    template <typename OtherCountT>
+    inline void addObserved(const ReadKmerDist<K, OtherCountT>& other) {
+      for (size_t i = 0; i < counts.size(); ++i) {
+	counts[i] += other.counts[i] - 1;
+      }
+    }
+
     inline uint64_t totalCount() {
       CountT c{0};
       for (auto const& rc : counts) { c += rc; }
       return c;
     }
 
-    // update the k-mer context for the hit at position p.
-    // The underlying transcript is from [start, end)
-    inline bool update(const char* start, const char *p, const char *end,
+    // update the k-mer context for the hit at position p of
+    // the transcript txp.
+    inline bool update(const PackedSequenceView& txp, int64_t p,
 	sailfish::utils::Direction dir) {
       using sailfish::utils::Direction;
       int posBeforeHit = 2;
       int posAfterHit = 4;
+      int64_t end = static_cast<int64_t>(txp.size());
       bool success{false};
       switch (dir) {
 	case Direction::FORWARD :
 	  {
 	    // If we can fit the window before and after the read
-	    if ((p - start) >= posBeforeHit and
+	    if (p >= posBeforeHit and
 		((p - posBeforeHit + K) < end) ) {
 	      p -= posBeforeHit;
 	      // If the read matches in the forward direction, we take
 	      // the RC sequence.
-	      auto idx = indexForKmer(p, K, Direction::REVERSE_COMPLEMENT);
+	      auto idx = txp.kmerIndex(p, K, Direction::REVERSE_COMPLEMENT);
 	      if (idx > counts.size()) { return false; }
 	      counts[idx]++;
 	      success = true;
@@ -56,10 +67,10 @@ class ReadKmerDist {
 	  break;
 	case Direction::REVERSE_COMPLEMENT :
 	  {
-	    if ((p - start) >= posAfterHit and
+	    if (p >= posAfterHit and
 		((p - posAfterHit + K) < end) ) {
 	      p -= posAfterHit;
-	      auto idx = indexForKmer(p, K, Direction::FORWARD);
+	      auto idx = txp.kmerIndex(p, K, Direction::FORWARD);
 	      if (idx > counts.size()) { return false; }
 	      counts[idx]++;
 	      success = true;
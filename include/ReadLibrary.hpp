@@ -30,6 +30,7 @@ public:
         unmatedFilenames_(rl.unmatedFilenames_),
         mateOneFilenames_(rl.mateOneFilenames_),
         mateTwoFilenames_(rl.mateTwoFilenames_),
+        interleavedFilenames_(rl.interleavedFilenames_),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(LibraryFormat::maxLibTypeID() + 1)) {
             auto mc = LibraryFormat::maxLibTypeID() + 1;
             for (size_t i = 0; i < mc; ++i) { libTypeCounts_[i].store(rl.libTypeCounts_[i].load()); }
@@ -43,6 +44,7 @@ public:
         unmatedFilenames_(std::move(rl.unmatedFilenames_)),
         mateOneFilenames_(std::move(rl.mateOneFilenames_)),
         mateTwoFilenames_(std::move(rl.mateTwoFilenames_)),
+        interleavedFilenames_(std::move(rl.interleavedFilenames_)),
         libTypeCounts_(std::vector<std::atomic<uint64_t>>(LibraryFormat::maxLibTypeID() + 1)) {
             auto mc = LibraryFormat::maxLibTypeID() + 1;
             for (size_t i = 0; i < mc; ++i) { libTypeCounts_[i].store(rl.libTypeCounts_[i].load()); }
@@ -62,6 +64,14 @@ public:
         mateTwoFilenames_ = mateTwoFilenames;
     }
 
+    /**
+     * Add files containing interleaved mated reads (the #1 and #2 mate of
+     * each pair are consecutive records of the same file) to this library.
+     */
+    void addInterleaved(const std::vector<std::string>& interleavedFilenames) {
+        interleavedFilenames_ = interleavedFilenames;
+    }
+
     /**
      * Add files containing unmated reads.
      */
@@ -86,11 +96,18 @@ public:
         for (auto& fn : filenames) {
             auto fpath = bfs::path(fn);
             auto ext = fpath.extension().string();
+            // gzipped files are decompressed by the parser; check the
+            // extension of the underlying file.
+            if (ext == ".gz" or ext == ".GZ") {
+                ext = fpath.stem().extension().string();
+            }
             if (bfs::is_regular_file(fpath)) {
                 if (acceptableExensions.find(ext) == acceptableExensions.end()) {
                     errorStream << "ERROR: file [" << fn << "] has extension " << ext << ", "
-                        << "which suggests it is neither a fasta nor a fastq file.\n"
-                        << "Is this a compressed file?  If so, consider replacing: \n\n"
+                        << "which suggests it is neither a fasta nor a fastq file (gzipped or not).\n"
+                        << "Gzip and BGZF compressed reads are read directly, as long as the file is "
+                        << "named like the uncompressed file plus a .gz suffix (e.g. reads.fq.gz).  "
+                        << "If the file is compressed in another format (e.g. bzip2), consider replacing: \n\n"
                         << fn << "\n\nwith\n\n"
                         << "<(decompressor " << fn << ")\n\n"
                         << "which will decompress the reads \"on-the-fly\"\n\n";
@@ -108,6 +125,9 @@ public:
 
     bool isRegularFile() {
         if (isPairedEnd()) {
+            for (auto& il : interleavedFilenames_) {
+                if (!boost::filesystem::is_regular_file(il)) { return false; }
+            }
             for (auto& m1 : mateOneFilenames_) {
                 if (!boost::filesystem::is_regular_file(m1)) { return false; }
             }
@@ -124,7 +144,13 @@ public:
 
     std::string readFilesAsString() {
         std::stringstream sstr;
-        if (isPairedEnd()) {
+        if (isPairedEnd() and isInterleaved()) {
+            size_t n = interleavedFilenames_.size();
+            for (size_t i = 0; i < n; ++i) {
+                sstr << "( " << interleavedFilenames_[i] << " )";
+                if (i != n - 1) { sstr << ", "; }
+            }
+        } else if (isPairedEnd()) {
             size_t n1 = mateOneFilenames_.size();
             size_t n2 = mateTwoFilenames_.size();
             if (n1 == 0 or n2 == 0 or n1 != n2) {
@@ -166,8 +192,15 @@ public:
         if (isPairedEnd()) {
             size_t n1 = mateOneFilenames_.size();
             size_t n2 = mateTwoFilenames_.size();
-            if (n1 == 0 or n2 == 0 or n1 != n2) {
-                errorStream << "You must provide #1 and #2 mated read files with a paired-end library type\n";
+            if (isInterleaved()) {
+                if (n1 > 0 or n2 > 0) {
+                    errorStream << "A paired-end library can contain either interleaved read files or "
+                                   "#1 and #2 mated read files, but not both\n";
+                    readsOK = false;
+                }
+            } else if (n1 == 0 or n2 == 0 or n1 != n2) {
+                errorStream << "You must provide #1 and #2 mated read files (or interleaved read files) "
+                               "with a paired-end library type\n";
                 readsOK = false;
             }
         } else {
@@ -188,6 +221,7 @@ public:
         readsOK = readsOK && checkFileExtensions_(mateOneFilenames_, errorStream);
         readsOK = readsOK && checkFileExtensions_(mateTwoFilenames_, errorStream);
         readsOK = readsOK && checkFileExtensions_(unmatedFilenames_, errorStream);
+        readsOK = readsOK && checkFileExtensions_(interleavedFilenames_, errorStream);
 
         if (!readsOK) {
             throw std::invalid_argument(errorStream.str());
@@ -204,6 +238,17 @@ public:
      */
     const std::vector<std::string>& mates2() const { return mateTwoFilenames_; }
 
+    /**
+     * Return the vector of files containing interleaved mated reads for this library.
+     */
+    const std::vector<std::string>& interleaved() const { return interleavedFilenames_; }
+
+    /**
+     * Return true if the mated reads of this library are interleaved in
+     * a single set of files.
+     */
+    bool isInterleaved() const { return !interleavedFilenames_.empty(); }
+
     /**
      * Return the vector of files containing the unmated reads for the library.
      */
@@ -232,6 +277,7 @@ private:
     std::vector<std::string> unmatedFilenames_;
     std::vector<std::string> mateOneFilenames_;
     std::vector<std::string> mateTwoFilenames_;
+    std::vector<std::string> interleavedFilenames_;
     std::vector<std::atomic<uint64_t>> libTypeCounts_;
 };
 
@@ -0,0 +1,151 @@
+#ifndef READ_MAPPING_CACHE_HPP
+#define READ_MAPPING_CACHE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SailfishSpinLock.hpp"
+#include "xxhash.h"
+
+/**
+ * Everything that mapping a fragment contributes to the quantification:
+ * the equivalence class it was assigned to (if any), the strand counts,
+ * the length of the fragment if it was a unique concordant mapping, and
+ * the hit statistics.
+ */
+struct ReadMappingResult {
+    // Classes with more transcripts than this aren't cached
+    static constexpr uint32_t maxTxps = 14;
+
+    // The number of transcripts in the class; 0 if the fragment didn't map
+    uint32_t numTxps{0};
+    uint32_t txps[maxTxps];
+    int32_t numFwd{0};
+    int32_t numRC{0};
+    // The number of quasi-mappings (for the hits per fragment statistic)
+    uint32_t numHits{0};
+    // True if there were any hits before they were filtered
+    bool hadHits{false};
+    // The fragment length of a unique, concordant mapping, or -1
+    int32_t fragLen{-1};
+    // False if the class was too large to be stored
+    bool cacheable{true};
+
+    void clear() {
+        numTxps = 0;
+        numFwd = numRC = 0;
+        numHits = 0;
+        hadHits = false;
+        fragLen = -1;
+        cacheable = true;
+    }
+
+    void setClass(const std::vector<uint32_t>& txpIDs, int32_t fwd, int32_t rc) {
+        if (txpIDs.size() > maxTxps) {
+            cacheable = false;
+            return;
+        }
+        numTxps = static_cast<uint32_t>(txpIDs.size());
+        std::memcpy(txps, txpIDs.data(), numTxps * sizeof(uint32_t));
+        numFwd = fwd;
+        numRC = rc;
+    }
+};
+
+/**
+ * A bounded cache from the sequence of a read (or read pair) to the
+ * result of mapping it, shared by all of the mapping threads, so that
+ * exact duplicate fragments needn't be mapped again.  The cache is direct
+ * mapped (a new entry simply replaces whatever was in its slot) and each
+ * slot has its own spin lock.  Keys are 128-bit hashes of the sequence(s),
+ * so the sequences themselves aren't stored.
+ */
+class ReadMappingCache {
+    public:
+        struct Key {
+            uint64_t h1{0};
+            uint64_t h2{0};
+        };
+
+        explicit ReadMappingCache(size_t numSlots) :
+            slots_(roundUpToPowerOfTwo(numSlots)), mask_(slots_.size() - 1) {}
+
+        static Key keyFor(const char* seq, size_t len) {
+            Key k;
+            k.h1 = XXH64(seq, len, seed1_);
+            k.h2 = XXH64(seq, len, seed2_);
+            return k;
+        }
+
+        static Key keyFor(const char* left, size_t leftLen,
+                          const char* right, size_t rightLen) {
+            Key k = keyFor(left, leftLen);
+            // Chain the hashes so that (a, b) and (b, a) differ
+            k.h1 = XXH64(right, rightLen, k.h1);
+            k.h2 = XXH64(right, rightLen, k.h2);
+            return k;
+        }
+
+        static Key keyFor(const std::string& seq) {
+            return keyFor(seq.data(), seq.size());
+        }
+
+        static Key keyFor(const std::string& left, const std::string& right) {
+            return keyFor(left.data(), left.size(), right.data(), right.size());
+        }
+
+        /**
+         * Start loading the slot for key `k` into the cache; the mapping
+         * loop calls this for the next read while it maps the current one.
+         */
+        void prefetch(const Key& k) const {
+            __builtin_prefetch(&slots_[k.h1 & mask_]);
+        }
+
+        /**
+         * If the fragment with key `k` is in the cache, copy its result to
+         * `out` and return true; otherwise return false.
+         */
+        bool lookup(const Key& k, ReadMappingResult& out) {
+            auto& slot = slots_[k.h1 & mask_];
+            spin_lock::scoped_lock sl(slot.lock);
+            if (!slot.full or slot.key.h1 != k.h1 or slot.key.h2 != k.h2) {
+                return false;
+            }
+            out = slot.result;
+            return true;
+        }
+
+        void insert(const Key& k, const ReadMappingResult& r) {
+            if (!r.cacheable) { return; }
+            auto& slot = slots_[k.h1 & mask_];
+            spin_lock::scoped_lock sl(slot.lock);
+            slot.key = k;
+            slot.result = r;
+            slot.full = true;
+        }
+
+    private:
+        static size_t roundUpToPowerOfTwo(size_t n) {
+            size_t capacity{1};
+            while (capacity < n) { capacity <<= 1; }
+            return capacity;
+        }
+
+        struct Slot {
+            spin_lock lock;
+            bool full{false};
+            Key key;
+            ReadMappingResult result;
+        };
+
+        static constexpr uint64_t seed1_{0x9e3779b97f4a7c15ULL};
+        static constexpr uint64_t seed2_{0xc2b2ae3d27d4eb4fULL};
+
+        std::vector<Slot> slots_;
+        size_t mask_;
+};
+
+#endif // READ_MAPPING_CACHE_HPP
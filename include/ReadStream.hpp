@@ -0,0 +1,40 @@
+#ifndef READ_STREAM_HPP
+#define READ_STREAM_HPP
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+
+namespace sailfish {
+    namespace io {
+
+        /**
+         * The file name that refers to the standard input.
+         */
+        constexpr const char* stdinName = "-";
+
+        /**
+         * Returns true if the stream begins with the gzip magic number.
+         * The stream is not advanced.
+         */
+        bool isGZipped(std::istream& is);
+
+        /**
+         * Open the read file `fname` for parsing.  If the file is gzip
+         * compressed, the returned stream transparently decompresses it.
+         * BGZF files (blocked gzip, as written by bgzip / samtools) are
+         * decompressed in parallel using `numDecompressionThreads` threads;
+         * regular gzip files are inflated ahead of the parser on a dedicated
+         * thread.  Uncompressed files are returned as a plain std::ifstream.
+         * Named pipes work like regular files, and a `fname` of "-" reads
+         * from the standard input.
+         *
+         * The returned stream evaluates to false if the file couldn't be opened.
+         */
+        std::unique_ptr<std::istream> openReadStream(const std::string& fname,
+                                                     uint32_t numDecompressionThreads = 1);
+    }
+}
+
+#endif // READ_STREAM_HPP
@@ -1,19 +1,28 @@
 #ifndef __SAILFISH_INDEX_HPP__
 #define __SAILFISH_INDEX_HPP__
 
+#include <algorithm>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 #include <boost/range/irange.hpp>
 
 #include "spdlog/spdlog.h"
 #include "cereal/archives/json.hpp"
+#include "cereal/archives/binary.hpp"
+#include "cereal/types/string.hpp"
 #include "cereal/types/vector.hpp"
 
 #include "RapMapSAIndex.hpp"
 #include "IndexHeader.hpp"
 #include "SailfishConfig.hpp"
 #include "SailfishIndexVersionInfo.hpp"
+#include "KmerBloomFilter.hpp"
+#include "PackedSequence.hpp"
 
 // declaration of quasi index function
 int rapMapSAIndex(int argc, char* argv[]);
@@ -39,18 +48,50 @@ class SailfishIndex{
             }
             // Check index version compatibility here
             loadQuasiIndex_(indexDir);
+            loadKmerFilter_(indexDir);
+            indexDir_ = indexDir;
             loaded_ = true;
         }
 
+        /**
+         * Build the quasi-index and, if filterBitsPerKmer > 0, the k-mer
+         * filter used to reject reads that can't map (with numThreads
+         * threads).
+         */
         bool build(boost::filesystem::path indexDir,
-                std::vector<const char*>& argVec, uint32_t k) {
-            return buildQuasiIndex_(indexDir, argVec, k);
+                std::vector<const char*>& argVec, uint32_t k,
+                uint32_t filterBitsPerKmer, uint32_t numThreads) {
+            bool ret = buildQuasiIndex_(indexDir, argVec, k);
+            if (ret) {
+                // The rest is built from the text of the quasi-index alone
+                std::string seq = loadQuasiIndexText_(indexDir);
+                recordSuffixArraySize_(indexDir, seq.size());
+                buildPackedTranscriptome_(indexDir, seq);
+                if (filterBitsPerKmer > 0) {
+                    buildKmerFilter_(indexDir, seq, k, filterBitsPerKmer, numThreads);
+                }
+            }
+            return ret;
         }
 
         bool loaded() { return loaded_; }
+        // The directory the index was loaded from
+        const boost::filesystem::path& indexDirectory() const { return indexDir_; }
         bool is64BitQuasi() { return largeIndex_; }
         RapMapSAIndex<int32_t>* quasiIndex32() { return quasiIndex32_.get(); }
         RapMapSAIndex<int64_t>* quasiIndex64() { return quasiIndex64_.get(); }
+        // The k-mer filter, or nullptr if the index doesn't have one
+        const KmerBloomFilter* kmerFilter() { return kmerFilter_.get(); }
+        /**
+         * The transcriptome sequence, with 2 bits per base, for the bias
+         * passes.  This is a copy of (rather than a replacement for) the
+         * quasi-index's text, which the mapping needs, so it is only loaded
+         * (mapped) the first time it is asked for.
+         */
+        const PackedSequence* packedTranscriptome() {
+            std::call_once(packedTxomeLoaded_, [this]() { loadPackedTranscriptome_(indexDir_); });
+            return packedTxome_.get();
+        }
 
         const char* transcriptomeSeq() {
             if (loaded_) {
@@ -100,6 +141,123 @@ class SailfishIndex{
             return (ret == 0);
         }
 
+        const std::string& quasiIndexSeq_() {
+            return largeIndex_ ? quasiIndex64_->seq : quasiIndex32_->seq;
+        }
+
+        /**
+         * Read just the text of the (just built) quasi-index, which is
+         * stored after the transcript names and offsets, rather than load
+         * the whole index (with its suffix array and hash) to get it.
+         */
+        std::string loadQuasiIndexText_(const boost::filesystem::path& indexDir) {
+            IndexHeader h;
+            {
+                std::ifstream headerStream((indexDir / "header.json").string());
+                cereal::JSONInputArchive ar(headerStream);
+                ar(h);
+            }
+            largeIndex_ = h.bigSA();
+            std::string seq;
+            boost::filesystem::path seqPath = indexDir / "txpInfo.bin";
+            std::ifstream seqStream(seqPath.string(), std::ios::binary);
+            if (!seqStream) {
+                throw std::runtime_error("Couldn't read the quasi-index's text from " + seqPath.string());
+            }
+            {
+                cereal::BinaryInputArchive ar(seqStream);
+                decltype(RapMapSAIndex<int32_t>::txpNames) txpNames;
+                if (largeIndex_) {
+                    decltype(RapMapSAIndex<int64_t>::txpOffsets) txpOffsets;
+                    ar(txpNames, txpOffsets, seq);
+                } else {
+                    decltype(RapMapSAIndex<int32_t>::txpOffsets) txpOffsets;
+                    ar(txpNames, txpOffsets, seq);
+                }
+            }
+            return seq;
+        }
+
+        // The suffix array has one entry per position of the sequence
+        void recordSuffixArraySize_(boost::filesystem::path indexDir, uint64_t seqLen) {
+            uint32_t entryBytes = largeIndex_ ? sizeof(int64_t) : sizeof(int32_t);
+            uint64_t totalBytes = seqLen * entryBytes;
+            logger_->info("The suffix array has {}-byte entries ({} MB)",
+                          entryBytes, totalBytes / (1024 * 1024));
+            versionInfo_.suffixArraySize(entryBytes, totalBytes);
+            boost::filesystem::path versionFile = indexDir / "versionInfo.json";
+            versionInfo_.save(versionFile);
+        }
+
+        /**
+         * The packed transcriptome (like the filter below) is built from
+         * the sequence stored in the (just built) quasi-index, so that the
+         * transcript offsets of the index apply to it.
+         */
+        void buildPackedTranscriptome_(const boost::filesystem::path& indexDir,
+                                       const std::string& seq) {
+            PackedSequence(seq.data(), seq.size()).save((indexDir / PackedSequence::fileName).string());
+        }
+
+        void loadPackedTranscriptome_(const boost::filesystem::path& indexDir) {
+            boost::filesystem::path packedPath = indexDir / PackedSequence::fileName;
+            packedTxome_.reset(new PackedSequence);
+            try {
+                packedTxome_->load(packedPath.string());
+            } catch (std::runtime_error& e) {
+                // Indices built before it existed are packed when loaded
+                const std::string& seq = quasiIndexSeq_();
+                packedTxome_.reset(new PackedSequence(seq.data(), seq.size()));
+            }
+            logger_->info("{} the packed transcriptome ({} MB)",
+                          packedTxome_->isMapped() ? "Mapped" : "Built",
+                          packedTxome_->sizeInBytes() / (1024 * 1024));
+        }
+
+        /**
+         * The filter is built from the sequence stored in the (just built)
+         * index rather than from the FASTA file, so that it contains
+         * exactly the k-mers that the index does.
+         */
+        void buildKmerFilter_(const boost::filesystem::path& indexDir, const std::string& seq,
+                              uint32_t k, uint32_t bitsPerKmer, uint32_t numThreads) {
+            if (k > 31) {
+                logger_->warn("The k-mer filter supports k <= 31; not building it");
+                return;
+            }
+            logger_->info("Building the k-mer filter ({} bits per k-mer)", bitsPerKmer);
+            KmerBloomFilter filter(k, seq.size(), bitsPerKmer);
+            // Each thread adds the k-mers that start in its part of the
+            // sequence, so the parts overlap by k - 1 characters
+            size_t numParts = std::max(1u, numThreads);
+            size_t partLen = (seq.size() + numParts - 1) / numParts;
+            std::vector<std::thread> threads;
+            for (size_t start = 0; start < seq.size(); start += partLen) {
+                size_t len = std::min(partLen + k - 1, seq.size() - start);
+                threads.emplace_back([&filter, &seq, start, len]() {
+                        filter.addKmers(seq.data() + start, len);
+                });
+            }
+            for (auto& t : threads) { t.join(); }
+            filter.save((indexDir / KmerBloomFilter::fileName).string());
+            logger_->info("done (the filter is {} MB)", filter.sizeInBytes() / (1024 * 1024));
+        }
+
+        void loadKmerFilter_(const boost::filesystem::path& indexDir) {
+            boost::filesystem::path filterPath = indexDir / KmerBloomFilter::fileName;
+            // Indices built before the filter existed simply don't use it
+            if (!boost::filesystem::exists(filterPath)) { return; }
+            kmerFilter_.reset(new KmerBloomFilter);
+            try {
+                kmerFilter_->load(filterPath.string());
+                logger_->info("Mapped the k-mer filter ({} MB)",
+                              kmerFilter_->sizeInBytes() / (1024 * 1024));
+            } catch (std::runtime_error& e) {
+                logger_->warn("{}; reads will not be pre-filtered", e.what());
+                kmerFilter_.reset();
+            }
+        }
+
         bool loadQuasiIndex_(const boost::filesystem::path& indexDir) {
             namespace bfs = boost::filesystem;
             logger_->info("Loading Quasi index");
@@ -144,6 +302,7 @@ class SailfishIndex{
 
 
         bool loaded_;
+        boost::filesystem::path indexDir_;
         SailfishIndexVersionInfo versionInfo_;
         //std::unique_ptr<RapMapSAIndex> quasiIndex_{nullptr};
         // Can't think of a generally better way to do this now
@@ -151,6 +310,9 @@ class SailfishIndex{
         bool largeIndex_{false};
         std::unique_ptr<RapMapSAIndex<int32_t>> quasiIndex32_{nullptr};
         std::unique_ptr<RapMapSAIndex<int64_t>> quasiIndex64_{nullptr};
+        std::unique_ptr<KmerBloomFilter> kmerFilter_{nullptr};
+        std::unique_ptr<PackedSequence> packedTxome_{nullptr};
+        std::once_flag packedTxomeLoaded_;
         std::shared_ptr<spdlog::logger> logger_;
 };
 
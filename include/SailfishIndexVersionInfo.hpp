@@ -43,7 +43,9 @@ class SailfishIndexVersionInfo {
             {
                 cereal::JSONOutputArchive oarchive(ofs);
                 oarchive(cereal::make_nvp("indexVersion", indexVersion_),
-                        cereal::make_nvp("kmerLength", kmerLength_));
+                        cereal::make_nvp("kmerLength", kmerLength_),
+                        cereal::make_nvp("suffixArrayEntryBytes", suffixArrayEntryBytes_),
+                        cereal::make_nvp("suffixArrayBytes", suffixArrayBytes_));
             }
             ofs.close();
             return true;
@@ -55,9 +57,21 @@ class SailfishIndexVersionInfo {
         uint32_t kmerLength() { return kmerLength_; }
         void kmerLength(uint32_t len) { kmerLength_ = len; };
 
+        /**
+         * The size of each suffix array entry (4 or 8 bytes) and of the
+         * whole suffix array, which dominates the memory quant needs.
+         * These are only written, for reference; they aren't read back.
+         */
+        void suffixArraySize(uint32_t entryBytes, uint64_t totalBytes) {
+            suffixArrayEntryBytes_ = entryBytes;
+            suffixArrayBytes_ = totalBytes;
+        }
+
     private:
         uint32_t indexVersion_;
         uint32_t kmerLength_;
+        uint32_t suffixArrayEntryBytes_{0};
+        uint64_t suffixArrayBytes_{0};
 };
 
 #endif // __SAILFISH_INDEX_VERSION_INFO_HPP__
@@ -8,6 +8,15 @@
 
 struct SailfishOpts {
     uint32_t numThreads; // number of threads to use
+    uint32_t numDecompressionThreads{1}; // number of threads used to decompress the read files of a library
+    uint32_t numParsingThreads{0}; // max. number of files (or file pairs) of a library parsed concurrently (0 = auto)
+    uint32_t numReadAheadBatches{0}; // number of parsed read batches buffered per library (0 = auto)
+    std::string metricsFile; // if non-empty, mapping metrics are periodically written here (JSON)
+    uint32_t metricsInterval{5}; // seconds between updates of the metrics file
+    uint32_t readCacheSize{0}; // number of slots in the duplicate read cache (0 = no cache)
+    uint32_t bucketWindow{0}; // number of reads reordered by minimizer before mapping (0 = file order)
+    bool prefetchAnchors{false}; // prefetch the index entries of the next reads' first k-mers
+    double maxDustScore{0.0}; // reads with a higher DUST score aren't mapped (0 = no low-complexity filter)
     bool allowOrphans;
     std::string auxDir;
     bool dumpEq{false};
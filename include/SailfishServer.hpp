@@ -0,0 +1,21 @@
+#ifndef SAILFISH_SERVER_HPP
+#define SAILFISH_SERVER_HPP
+
+#include <string>
+
+namespace sailfish {
+namespace server {
+
+/**
+ * Run the quant command line argv[0, argc) on the `sailfish serve` process
+ * listening on socketPath, and wait for it to finish.  The job runs in the
+ * current working directory, and writes to this process' standard output
+ * and error.  Returns the exit status of the job (or 1 if the server
+ * couldn't be reached).
+ */
+int submitQuantJob(const std::string& socketPath, int argc, char* argv[]);
+
+} // namespace server
+} // namespace sailfish
+
+#endif // SAILFISH_SERVER_HPP
@@ -67,6 +67,59 @@ namespace sailfish{
         LibraryFormat hitType(int32_t end1Start, bool end1Fwd, uint32_t len1,
                               int32_t end2Start, bool end2Fwd, uint32_t len2, bool canDovetail);
 
+        // The same as hitType(...).formatID(), without building the LibraryFormat
+        inline uint8_t hitTypeID(int32_t end1Start, bool end1Fwd, uint32_t len1,
+                                 int32_t end2Start, bool end2Fwd, uint32_t len2, bool canDovetail) {
+            constexpr auto PE = ReadType::PAIRED_END;
+            if (end1Fwd != end2Fwd) {
+                // The strand of read 1 decides SA vs. AS, and which read
+                // starts first decides inward vs. outward
+                int32_t stretch = canDovetail ? (end1Fwd ? len2 : len1) : 0;
+                bool toward = end1Fwd ? (end1Start <= end2Start + stretch) :
+                                        (end2Start <= end1Start + stretch);
+                auto rs = end1Fwd ? ReadStrandedness::SA : ReadStrandedness::AS;
+                return toward ? LibraryFormat::formatIDFor(PE, ReadOrientation::TOWARD, rs) :
+                                LibraryFormat::formatIDFor(PE, ReadOrientation::AWAY, rs);
+            }
+            return end1Fwd ? LibraryFormat::formatIDFor(PE, ReadOrientation::SAME, ReadStrandedness::S) :
+                             LibraryFormat::formatIDFor(PE, ReadOrientation::SAME, ReadStrandedness::A);
+        }
+
+        /**
+         * The compatibility of each kind of hit with an expected library
+         * format, computed once with compatibleHit() so that the mapping
+         * loop only has to do table lookups.
+         */
+        class LibraryCompatibility {
+            public:
+                explicit LibraryCompatibility(const LibraryFormat& expected);
+
+                // The same as compatibleHit(expected, start, isForward, ms)
+                inline bool compatible(MateStatus ms, bool isForward) const {
+                    return single_[mateIndex(ms)][isForward];
+                }
+
+                // The same as compatibleHit(expected, formatFromID(observedID))
+                inline bool compatible(uint8_t observedID) const {
+                    return paired_[observedID];
+                }
+
+            private:
+                static inline uint32_t mateIndex(MateStatus ms) {
+                    switch (ms) {
+                        case MateStatus::SINGLE_END: return 0;
+                        case MateStatus::PAIRED_END_LEFT: return 1;
+                        case MateStatus::PAIRED_END_RIGHT: return 2;
+                        default: return 3;
+                    }
+                }
+
+                // Indexed by mateIndex(ms) and isForward
+                bool single_[4][2];
+                // Indexed by the formatID of the observed library type
+                bool paired_[LibraryFormat::maxLibTypeID() + 1];
+        };
+
 
         LibraryFormat parseLibraryFormatStringNew(std::string& fmt);
 
@@ -0,0 +1,170 @@
+#ifndef __SINGLE_SEQUENCE_PARSER_HPP__
+#define __SINGLE_SEQUENCE_PARSER_HPP__
+
+#include <string>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+
+#include <jellyfish/err.hpp>
+#include <jellyfish/cooperative_pool2.hpp>
+#include <jellyfish/cpp_array.hpp>
+
+#include "ReadBatch.hpp"
+#include "ReadStream.hpp"
+
+/// The single-end counterpart of pair_sequence_parser.  Unlike
+/// jellyfish's whole_sequence_parser, the files are opened through
+/// sailfish::io::openReadStream, so gzipped input is supported.
+template<typename PathIterator>
+class single_sequence_parser : public jellyfish::cooperative_pool2<single_sequence_parser<PathIterator>, single_read_batch> {
+  typedef jellyfish::cooperative_pool2<single_sequence_parser<PathIterator>, single_read_batch> super;
+  typedef std::unique_ptr<std::istream> stream_type;
+  typedef std::unique_ptr<fastx_line_reader> reader_type;
+  enum file_type { DONE_TYPE, FASTA_TYPE, FASTQ_TYPE, ERROR_TYPE };
+
+  struct stream_status {
+    file_type   type;
+    stream_type stream;
+    reader_type reader;
+
+    stream_status() : type(DONE_TYPE) { }
+  };
+  jellyfish::cpp_array<stream_status> streams_;
+  PathIterator                        path_begin_, path_end_;
+  std::mutex                          path_mutex_;
+  uint32_t                            decomp_threads_;
+  bool                                keep_headers_;
+  bool                                keep_quals_;
+  std::atomic<uint64_t>               nb_produced_;
+  std::atomic<uint64_t>               nb_consumed_;
+
+public:
+  /// Size is the number of buffers to keep around. It should be
+  /// larger than the number of thread expected to read from this
+  /// class. nb_sequences is the number of sequences to read into a
+  /// buffer. 'begin' and 'end' are iterators to a range of paths.
+  /// Read headers and quality values are only stored if keep_headers /
+  /// keep_quals are set.
+  single_sequence_parser(uint32_t size, uint32_t nb_sequences,
+                         uint32_t max_producers,
+                         PathIterator path_begin, PathIterator path_end,
+                         uint32_t decomp_threads = 1,
+                         bool keep_headers = false, bool keep_quals = false) :
+    super(max_producers, size),
+    streams_(max_producers),
+    path_begin_(path_begin), path_end_(path_end),
+    decomp_threads_(decomp_threads),
+    keep_headers_(keep_headers), keep_quals_(keep_quals),
+    nb_produced_(0), nb_consumed_(0)
+  {
+    for(auto it = super::element_begin(); it != super::element_end(); ++it) {
+      it->nb_filled = 0;
+      it->data.resize(nb_sequences);
+      it->arena.reserve(nb_sequences * 128);
+    }
+    for(uint32_t i = 0; i < max_producers; ++i) {
+      streams_.init(i);
+      open_next_file(streams_[i]);
+    }
+  }
+
+  inline bool produce(uint32_t i, single_read_batch& buff) {
+    stream_status& st = streams_[i];
+
+    switch(st.type) {
+    case FASTA_TYPE:
+      read_fasta(st, buff);
+      break;
+    case FASTQ_TYPE:
+      read_fastq(st, buff);
+      break;
+    case DONE_TYPE:
+    case ERROR_TYPE:
+      return true;
+    }
+    ++nb_produced_;
+
+    if(st.reader->good())
+      return false;
+
+    // Reach the end of file, close current and try to open the next one
+    open_next_file(st);
+    return false;
+  }
+
+  /// The number of batches filled so far, and the number that consumers
+  /// have reported taking with batch_consumed().  The difference is the
+  /// (approximate) number of parsed batches waiting to be processed.
+  uint64_t batches_produced() const { return nb_produced_; }
+  uint64_t batches_consumed() const { return nb_consumed_; }
+  void batch_consumed() { ++nb_consumed_; }
+
+protected:
+  file_type peek_file_type(fastx_line_reader& lr) {
+    switch(lr.peek()) {
+    case EOF: return DONE_TYPE;
+    case '>': return FASTA_TYPE;
+    case '@': return FASTQ_TYPE;
+    default: return ERROR_TYPE;
+    }
+  }
+
+  void open_next_file(stream_status& st) {
+    st.reader.reset();
+    st.stream.reset();
+    const char *p = 0;
+    {
+      std::lock_guard<std::mutex> lck(path_mutex_);
+      if(path_begin_ < path_end_) {
+        p = *path_begin_;
+        ++path_begin_;
+      }
+    }
+
+    if(!p) {
+      st.type = DONE_TYPE;
+      return;
+    }
+    st.stream = sailfish::io::openReadStream(p, decomp_threads_);
+    if(!*st.stream) {
+      st.type = DONE_TYPE;
+      return;
+    }
+    st.reader.reset(new fastx_line_reader(*st.stream));
+
+    // Update the type of the current file
+    file_type type = peek_file_type(*st.reader);
+    if(type == DONE_TYPE)
+      return open_next_file(st);
+    if(type == ERROR_TYPE)
+       throw std::runtime_error("Unsupported format");
+    st.type = type;
+  }
+
+  void read_fasta(stream_status& st, single_read_batch& buff) {
+    size_t&      nb_filled = buff.nb_filled;
+    const size_t data_size = buff.data.size();
+
+    buff.arena.clear();
+    for(nb_filled = 0; nb_filled < data_size && st.reader->peek() != EOF; ++nb_filled) {
+      read_fasta_record(*st.reader, buff, buff.data[nb_filled], keep_headers_);
+    }
+  }
+
+  void read_fastq(stream_status& st, single_read_batch& buff) {
+    size_t&      nb_filled = buff.nb_filled;
+    const size_t data_size = buff.data.size();
+
+    buff.arena.clear();
+    for(nb_filled = 0; nb_filled < data_size && st.reader->peek() != EOF; ++nb_filled) {
+      read_fastq_record(*st.reader, buff, buff.data[nb_filled], keep_headers_, keep_quals_);
+    }
+  }
+};
+
+#endif /* __SINGLE_SEQUENCE_PARSER_HPP__ */
@@ -0,0 +1,40 @@
+#ifndef SORTED_INTERSECTION_HPP
+#define SORTED_INTERSECTION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sailfish {
+namespace intersection {
+
+/**
+ * Intersect the sorted (non-decreasing) lists a[0, na) and b[0, nb),
+ * pairing up elements exactly as a scalar merge would: on a match, both
+ * lists advance by one.  The indices of the k-th matching pair are
+ * written to aIdx[k] and bIdx[k], which must have room for
+ * min(na, nb, limit + 1) entries.  The search stops as soon as more than
+ * `limit` pairs have been found.  Returns the number of pairs written.
+ *
+ * Runs of elements that are smaller than the current element of the
+ * other list are skipped with AVX2 (if the CPU supports it) or SSE2
+ * comparisons; there is a scalar fallback on other architectures, which
+ * is also used for short lists.
+ */
+size_t intersectSorted(const uint32_t* a, size_t na,
+                       const uint32_t* b, size_t nb,
+                       uint32_t* aIdx, uint32_t* bIdx,
+                       size_t limit);
+
+/**
+ * The portable version of intersectSorted (used on non-x86 CPUs, and for
+ * testing).
+ */
+size_t intersectSortedScalar(const uint32_t* a, size_t na,
+                             const uint32_t* b, size_t nb,
+                             uint32_t* aIdx, uint32_t* bIdx,
+                             size_t limit);
+
+} // namespace intersection
+} // namespace sailfish
+
+#endif // SORTED_INTERSECTION_HPP
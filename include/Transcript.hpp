@@ -8,12 +8,13 @@
 //#include "FragmentLengthDistribution.hpp"
 #include "tbb/atomic.h"
 #include "SailfishUtils.hpp"
+#include "PackedSequence.hpp"
 
 class Transcript {
 public:
     Transcript(size_t idIn, const char* name, uint32_t len) :
         RefName(name), RefLength(len), EffectiveLength(len), id(idIn),
-        Sequence_(nullptr), mass_(0.0), estCount_(0.0), active_(false) { }
+        mass_(0.0), estCount_(0.0), active_(false) { }
 
     Transcript(Transcript&& other) {
         id = other.id;
@@ -94,12 +95,13 @@ public:
       }
     }
 
-    void setSequence(const char* seq, bool needGC=false, uint32_t gcSampFactor=1) {
+    void setSequence(const PackedSequenceView& seq, bool needGC=false, uint32_t gcSampFactor=1) {
         Sequence_ = seq;
         if (needGC) { computeGCContent_(gcSampFactor); }
     }
 
-    const char* Sequence() const { return Sequence_; }
+    // The (2-bit packed) sequence of this transcript
+    const PackedSequenceView& Sequence() const { return Sequence_; }
 
     std::string RefName;
     uint32_t RefLength;
@@ -155,24 +157,23 @@ private:
 
     void computeGCContentSampled_(uint32_t step) {
         gcStep_ = step;
-        const char* seq = Sequence_;
         size_t nsamp = std::ceil(static_cast<double>(RefLength) / step);
         GCCount_.reserve(nsamp + 2);
 
+        // The GC count up to (and including) each sampled position,
+        // counted a whole word of the packed sequence at a time
         size_t lastSamp{0};
         size_t totGC{0};
-        for (size_t i = 0; i < RefLength; ++i) {
-            auto c = std::toupper(seq[i]);
-            if (c == 'G' or c == 'C') {
-                totGC++;
-            }
-            if (i % step == 0) {
-                GCCount_.push_back(totGC);
-                lastSamp = i;
-            }
+        size_t counted{0};
+        for (size_t i = 0; i < RefLength; i += step) {
+            totGC += Sequence_.gcCount(counted, i + 1 - counted);
+            counted = i + 1;
+            GCCount_.push_back(totGC);
+            lastSamp = i;
         }
 
         if (lastSamp < RefLength - 1) {
+            totGC += Sequence_.gcCount(counted, RefLength - counted);
             GCCount_.push_back(totGC);
         }
 
@@ -181,14 +182,14 @@ private:
     }
 
     void computeGCContent_(uint32_t gcSampFactor) {
-        const char* seq = Sequence_;
         GCCount_.clear();
         if (gcSampFactor == 1) {
             GCCount_.resize(RefLength, 0);
             size_t totGC{0};
             for (size_t i = 0; i < RefLength; ++i) {
-                auto c = std::toupper(seq[i]);
-                if (c == 'G' or c == 'C') {
+                // C and G are the codes 1 and 2 (and Ns are stored as A)
+                uint32_t c = Sequence_.code(i);
+                if (c == 1 or c == 2) {
                     totGC++;
                 }
                 GCCount_[i] = totGC;
@@ -198,7 +199,7 @@ private:
         }
     }
 
-    const char* Sequence_;
+    PackedSequenceView Sequence_;
     //std::unique_ptr<const char, void(*)(const char*)> Sequence =
     //    std::unique_ptr<const char, void(*)(const char*)>(nullptr, [](const char*) {});
     tbb::atomic<double> mass_;
@@ -0,0 +1,40 @@
+#ifndef TRANSCRIPT_PANEL_HPP
+#define TRANSCRIPT_PANEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sailfish {
+namespace panel {
+
+struct PanelSummary {
+    // The transcripts named in the panel file that were found
+    size_t numPanel{0};
+    // The other transcripts that share a k-mer with a panel transcript
+    size_t numNeighbours{0};
+    // The names in the panel file that weren't in the transcriptome
+    std::vector<std::string> missing;
+};
+
+/**
+ * Write to outFasta the transcripts of txpFasta that are named in
+ * panelFile (one name per line), along with every other transcript that
+ * shares a k-mer (of length k <= 31) with one of them.  A read that hits a
+ * panel transcript must share a k-mer with it, so transcripts outside of
+ * this neighbourhood can't compete with the panel for reads; keeping the
+ * neighbours means that reads from off-panel transcripts are still
+ * assigned to them, rather than to the panel transcripts they resemble.
+ * Throws std::invalid_argument if a file can't be read or no panel
+ * transcript is found.
+ */
+PanelSummary writePanelTranscriptome(const std::string& txpFasta,
+                                     const std::string& panelFile,
+                                     uint32_t k,
+                                     const std::string& outFasta);
+
+} // namespace panel
+} // namespace sailfish
+
+#endif // TRANSCRIPT_PANEL_HPP
@@ -1,7 +1,9 @@
 #ifndef UTILITY_FUNCTIONS_HPP
 #define UTILITY_FUNCTIONS_HPP
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 #include "SailfishUtils.hpp"
 
 // from http://stackoverflow.com/questions/17719674/c11-fast-constexpr-integer-powers
@@ -37,49 +39,48 @@ inline std::string kmerForIndex(uint32_t idx, uint32_t K) {
     return kmer;
 }
 
+/**
+ * The 2-bit encodings of each character, used by the k-mer index
+ * functions below.  Bits 0-1 hold the code of the nucleotide (A = 0,
+ * C = 1, G = 2, T/U = 3, in either case), bits 2-3 the code of its
+ * complement, and bit 4 is set for characters that aren't nucleotides
+ * (whose codes are 0).
+ */
+static const uint8_t nucleotideEncoding[256] = {
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 12, 16,  9, 16, 16, 16,  6, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16,  3,  3, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 12, 16,  9, 16, 16, 16,  6, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16,  3,  3, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+    16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
+};
+
+constexpr uint8_t invalidNucleotide = 0x10;
+
+inline uint32_t forwardCode(char c) {
+    return nucleotideEncoding[static_cast<uint8_t>(c)] & 0x3;
+}
+
+inline uint32_t complementCode(char c) {
+    return (nucleotideEncoding[static_cast<uint8_t>(c)] >> 2) & 0x3;
+}
+
 inline uint32_t nextKmerIndex(uint32_t idx, char n, uint32_t K,
                               sailfish::utils::Direction dir) {
     using sailfish::utils::Direction;
-    idx = idx << 2;
-    if(dir == Direction::REVERSE_COMPLEMENT) {
-        switch(n) {
-            case 'A':
-            case 'a':
-                n='T';
-                break;
-            case 'C':
-            case 'c':
-                n='G';
-                break;
-            case 'g':
-            case 'G':
-                n='C';
-                break;
-            case 'T':
-            case 't':
-            case 'U':
-            case 'u':
-                n='A';
-                break;
-        }
-    }
-
-    switch(n) {
-        case 'A':
-        case 'a': break;
-        case 'C':
-        case 'c': idx = idx + 1;
-                  break;
-        case 'G':
-        case 'g': idx = idx + 2;
-                  break;
-        case 'T':
-        case 't':
-        case 'U':
-        case 'u':
-                  idx = idx + 3;
-                  break;
-    }
+    // Characters other than nucleotides are treated as 'A'
+    idx = (idx << 2) | ((dir == Direction::REVERSE_COMPLEMENT) ?
+                        complementCode(n) : forwardCode(n));
     // Clear the top 32 - 2*K bits.
     uint32_t clearShift = (32 - 2*K);
     return idx & (0xFFFFFFFF >> clearShift);
@@ -92,57 +93,91 @@ inline uint32_t indexForKmer(const char* s,
     using sailfish::utils::Direction;
     // The index we'll return
     uint32_t idx{0};
-    // The number of bits we need to shift the
-    // current mask to the left.
     if(dir == Direction::FORWARD) {
         for (int32_t i = 0; i < K; ++i) {
-            switch (s[i]) {
-                case 'A':
-                case 'a':
-                    break;
-                case 'C':
-                case 'c':
-                    idx += 1;
-                    break;
-                case 'G':
-                case 'g':
-                    idx += 2;
-                    break;
-                case 'T':
-                case 't':
-                case 'U':
-                case 'u':
-                    idx += 3;
-                    break;
-                default:
-                    return std::numeric_limits<uint32_t>::max();
-            }
-            if (i < K - 1) {idx = idx << 2;}
+            uint8_t e = nucleotideEncoding[static_cast<uint8_t>(s[i])];
+            if (e & invalidNucleotide) { return std::numeric_limits<uint32_t>::max(); }
+            idx = (idx << 2) | (e & 0x3);
         }
     } else {
         for(int32_t i=K-1 ; i>=0 ; i--) {
-            switch(s[i]) {
-                case 'T':
-                case 't':
-                case 'u':
-                case 'U': break;
-                case 'C':
-                case 'c': idx += 2;
-                          break;
-                case 'G':
-                case 'g': idx += 1;
-                          break;
-                case 'A':
-                case 'a': idx += 3;
-                          break;
-                default:
-                    return std::numeric_limits<uint32_t>::max();
-            }
-            if (i > 0) {idx = idx << 2;}
+            uint8_t e = nucleotideEncoding[static_cast<uint8_t>(s[i])];
+            if (e & invalidNucleotide) { return std::numeric_limits<uint32_t>::max(); }
+            idx = (idx << 2) | ((e >> 2) & 0x3);
         }
     }
     return idx;
 }
 
+/**
+ * Fill idx[i], for 0 <= i < numKmers, with the index of the K-mer whose
+ * 2-bit codes are codes[i, i + K) (read backwards if rc is true, as for
+ * the reverse complement).  Each k-mer is built independently with K
+ * shift-or passes over the whole array, which the compiler can vectorize
+ * (unlike the serial rolling update).
+ */
+inline void kmerIndicesFromCodes(const std::vector<uint32_t>& codes,
+                                 size_t numKmers, uint32_t K, bool rc,
+                                 std::vector<uint32_t>& idx) {
+    idx.assign(numKmers, 0);
+    uint32_t* out = idx.data();
+    const uint32_t* c = codes.data();
+    for (uint32_t j = 0; j < K; ++j) {
+        // The forward k-mer reads s[i], ..., s[i + K - 1], and the
+        // reverse complement reads their complements backwards.
+        const uint32_t* cj = c + (rc ? (K - 1 - j) : j);
+        for (size_t i = 0; i < numKmers; ++i) {
+            out[i] = (out[i] << 2) | cj[i];
+        }
+    }
+}
+
+/**
+ * Fill idx[i], for 0 <= i < numKmers, with the index of the K-mer that
+ * starts at s + i (in direction dir), i.e. the value that rolling
+ * nextKmerIndex along the sequence would give.  Characters other than
+ * nucleotides are treated as 'A' (even in the first k-mer).  The
+ * sequence is encoded once with the lookup table, and the k-mers are then
+ * built by kmerIndicesFromCodes.
+ */
+inline void kmerIndices(const char* s, size_t numKmers, uint32_t K,
+                        sailfish::utils::Direction dir,
+                        std::vector<uint32_t>& idx,
+                        std::vector<uint32_t>& codes) {
+    using sailfish::utils::Direction;
+    size_t len = numKmers + K - 1;
+    codes.resize(len);
+    bool rc = (dir == Direction::REVERSE_COMPLEMENT);
+    for (size_t i = 0; i < len; ++i) {
+        codes[i] = rc ? complementCode(s[i]) : forwardCode(s[i]);
+    }
+    kmerIndicesFromCodes(codes, numKmers, K, rc, idx);
+}
+
+/**
+ * Call f on the canonical value (the smaller of the 2-bit encodings of the
+ * k-mer and of its reverse complement) of every k-mer of s[0, len), for
+ * K <= 31, skipping those that contain a character other than a
+ * nucleotide.  Stops as soon as f returns true, and returns true if it did.
+ */
+template <typename F>
+inline bool forEachCanonicalKmer(const char* s, size_t len, uint32_t K, F f) {
+    uint64_t mask = (uint64_t(1) << (2 * K)) - 1;
+    uint32_t rcShift = 2 * (K - 1);
+    uint64_t fwd{0};
+    uint64_t rc{0};
+    uint32_t valid{0};
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t e = nucleotideEncoding[static_cast<uint8_t>(s[i])];
+        if (e & invalidNucleotide) {
+            valid = 0;
+            continue;
+        }
+        fwd = ((fwd << 2) | (e & 0x3)) & mask;
+        rc = (rc >> 2) | (static_cast<uint64_t>((e >> 2) & 0x3) << rcShift);
+        if (++valid >= K and f(std::min(fwd, rc))) { return true; }
+    }
+    return false;
+}
 
 #endif //UTILITY_FUNCTIONS_HPP
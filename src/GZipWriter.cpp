@@ -185,6 +185,17 @@ bool GZipWriter::writeMeta(
       oa(cereal::make_nvp("num_processed", experiment.numObservedFragments()));
       oa(cereal::make_nvp("num_mapped", experiment.numMappedFragments()));
       oa(cereal::make_nvp("percent_mapped", experiment.mappingRate() * 100.0));
+      oa(cereal::make_nvp("num_too_many_hits", experiment.numTooManyHits()));
+      oa(cereal::make_nvp("num_rejected_kmer_filter", experiment.numKmerFiltered()));
+      oa(cereal::make_nvp("num_rejected_low_complexity", experiment.numLowComplexity()));
+      if (opts.readCacheSize > 0) {
+          uint64_t lookups = experiment.numReadCacheLookups();
+          uint64_t hits = experiment.numReadCacheHits();
+          oa(cereal::make_nvp("read_cache_lookups", lookups));
+          oa(cereal::make_nvp("read_cache_hits", hits));
+          oa(cereal::make_nvp("read_cache_hit_rate",
+                      (lookups > 0) ? static_cast<double>(hits) / lookups : 0.0));
+      }
       oa(cereal::make_nvp("call", std::string("quant")));
       oa(cereal::make_nvp("start_time", tstring));
   }
@@ -0,0 +1,136 @@
+#include "KmerBloomFilter.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include "UtilityFunctions.hpp"
+
+constexpr const char* KmerBloomFilter::fileName;
+constexpr size_t KmerBloomFilter::blockWords;
+constexpr size_t KmerBloomFilter::headerWords;
+
+namespace {
+
+constexpr uint64_t filterMagic{0x53464b4d424c4f4fULL};
+constexpr uint64_t filterFormatVersion{2};
+
+inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+} // anonymous namespace
+
+KmerBloomFilter::KmerBloomFilter(uint32_t k, uint64_t numKmers, uint32_t bitsPerKmer) : k_(k) {
+    if (k == 0 or k > 31) {
+        throw std::invalid_argument("The k-mer filter only supports k-mers of length 1 to 31");
+    }
+    uint64_t bitsPerBlock = blockWords * 64;
+    allocate_(std::max(uint64_t(1), (numKmers * bitsPerKmer + bitsPerBlock - 1) / bitsPerBlock));
+}
+
+void KmerBloomFilter::allocate_(uint64_t numBlocks) {
+    mapping_.reset();
+    numBlocks_ = numBlocks;
+    // One block extra, so that the first block can start on a cache line
+    storage_.assign((numBlocks_ + 1) * blockWords, 0);
+    uintptr_t p = reinterpret_cast<uintptr_t>(storage_.data());
+    uintptr_t lineBytes = blockWords * sizeof(uint64_t);
+    blocks_ = reinterpret_cast<uint64_t*>((p + lineBytes - 1) & ~(lineBytes - 1));
+}
+
+/**
+ * The high half of the hash picks the block; the bits within it are 9-bit
+ * fields of the hash multiplied by an odd constant, whose high bits depend
+ * on the whole hash.
+ */
+void KmerBloomFilter::insert_(uint64_t kmer) {
+    uint64_t h = mix(kmer);
+    uint64_t* block = blocks_ + ((h >> 32) * numBlocks_ >> 32) * blockWords;
+    uint64_t bits = h * 0x9e3779b97f4a7c15ULL;
+    for (uint32_t i = 0; i < bitsPerKey; ++i) {
+        uint32_t bit = (bits >> (64 - 9 * (i + 1))) & 0x1ff;
+        __atomic_fetch_or(&block[bit >> 6], uint64_t(1) << (bit & 0x3f), __ATOMIC_RELAXED);
+    }
+}
+
+bool KmerBloomFilter::contains_(uint64_t kmer) const {
+    uint64_t h = mix(kmer);
+    const uint64_t* block = blocks_ + ((h >> 32) * numBlocks_ >> 32) * blockWords;
+    uint64_t bits = h * 0x9e3779b97f4a7c15ULL;
+    for (uint32_t i = 0; i < bitsPerKey; ++i) {
+        uint32_t bit = (bits >> (64 - 9 * (i + 1))) & 0x1ff;
+        if (!(block[bit >> 6] & (uint64_t(1) << (bit & 0x3f)))) { return false; }
+    }
+    return true;
+}
+
+void KmerBloomFilter::addKmers(const char* s, size_t len) {
+    forEachCanonicalKmer(s, len, k_, [this](uint64_t kmer) -> bool {
+            insert_(kmer);
+            return false;
+    });
+}
+
+bool KmerBloomFilter::mayContainAnyKmer(const char* s, size_t len) const {
+    return forEachCanonicalKmer(s, len, k_, [this](uint64_t kmer) -> bool {
+            return contains_(kmer);
+    });
+}
+
+void KmerBloomFilter::save(const std::string& path) const {
+    std::ofstream ofs(path, std::ios::binary);
+    uint64_t header[headerWords] = {filterMagic, filterFormatVersion, k_, numBlocks_};
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(blocks_), sizeInBytes());
+    if (!ofs) {
+        throw std::runtime_error("Couldn't write the k-mer filter to " + path);
+    }
+}
+
+void KmerBloomFilter::load(const std::string& path) {
+    // Writes through the (private) mapping, by addKmers, would only
+    // modify this process' copy
+    MappedFile m(path);
+    const uint64_t* header = static_cast<const uint64_t*>(m.data());
+    if (m.size() < headerWords * sizeof(uint64_t) or
+        header[0] != filterMagic or header[1] != filterFormatVersion or
+        header[2] == 0 or header[2] > 31 or
+        m.size() != (headerWords + header[3] * blockWords) * sizeof(uint64_t)) {
+        throw std::runtime_error("The k-mer filter " + path + " is invalid");
+    }
+    storage_.clear();
+    storage_.shrink_to_fit();
+    k_ = static_cast<uint32_t>(header[2]);
+    numBlocks_ = header[3];
+    blocks_ = static_cast<uint64_t*>(m.data()) + headerWords;
+    mapping_ = std::move(m);
+}
+
+double dustScore(const char* s, size_t len) {
+    uint32_t counts[64] = {0};
+    uint32_t triplet{0};
+    uint32_t valid{0};
+    uint32_t numTriplets{0};
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t e = nucleotideEncoding[static_cast<uint8_t>(s[i])];
+        if (e & invalidNucleotide) {
+            valid = 0;
+            continue;
+        }
+        triplet = ((triplet << 2) | (e & 0x3)) & 0x3f;
+        if (++valid >= 3) {
+            ++counts[triplet];
+            ++numTriplets;
+        }
+    }
+    if (numTriplets < 2) { return 0.0; }
+    uint64_t pairs{0};
+    for (uint64_t c : counts) { pairs += (c > 0) ? c * (c - 1) / 2 : 0; }
+    return static_cast<double>(pairs) / (numTriplets - 1);
+}
@@ -0,0 +1,52 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Couldn't open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 or st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Couldn't map " + path + " (it is empty or unreadable)");
+    }
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void* m = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        throw std::runtime_error("Couldn't map " + path);
+    }
+    data_ = m;
+    size_ = bytes;
+}
+
+MappedFile::MappedFile(MappedFile&& other) : data_(other.data_), size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+    if (this != &other) {
+        reset();
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void MappedFile::reset() {
+    if (data_) {
+        munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include "cereal/archives/json.hpp"
+#include "cereal/types/string.hpp"
+#include "cereal/types/vector.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include "MappingMetrics.hpp"
+
+MappingMetricsReporter::MappingMetricsReporter(ReadExperiment& readExp,
+                                               const SailfishOpts& sfOpts,
+                                               std::mutex& iomutex) :
+    readExp_(readExp), sfOpts_(sfOpts), iomutex_(iomutex) {}
+
+MappingMetricsReporter::~MappingMetricsReporter() { stop(); }
+
+void MappingMetricsReporter::addQueue(const std::string& name,
+                                      std::function<int64_t()> depth) {
+    queueNames_.push_back(name);
+    queueDepths_.push_back(depth);
+}
+
+void MappingMetricsReporter::start() {
+    startTime_ = std::chrono::steady_clock::now();
+    lastWriteTime_ = startTime_;
+    lastWriteFragments_ = 0;
+    stop_ = false;
+    running_ = true;
+    thread_ = std::thread([this]() -> void { run_(); });
+}
+
+void MappingMetricsReporter::stop() {
+    if (!running_) { return; }
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stop_ = true;
+    }
+    stopCond_.notify_all();
+    thread_.join();
+    running_ = false;
+    if (sfOpts_.metricsFile.length() > 0) { writeMetrics_(true); }
+}
+
+void MappingMetricsReporter::run_() {
+    constexpr uint64_t progressInterval{500000};
+    auto writeInterval = std::chrono::seconds(std::max(1u, sfOpts_.metricsInterval));
+    uint64_t lastReported{0};
+
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stop_) {
+        stopCond_.wait_for(lock, std::chrono::milliseconds(250));
+        if (stop_) { break; }
+
+        uint64_t numObserved = readExp_.numObservedFragments();
+        if (numObserved / progressInterval > lastReported / progressInterval) {
+            uint64_t totalHits = readExp_.numFragHits();
+            iomutex_.lock();
+            fmt::print(stderr, "\033[A\r\rprocessed {} fragments\n", numObserved);
+            fmt::print(stderr, "hits: {}, hits per frag (may not be concordant):  {}",
+                    totalHits,
+                    totalHits / static_cast<float>(numObserved));
+            iomutex_.unlock();
+            lastReported = numObserved;
+        }
+
+        if (sfOpts_.metricsFile.length() > 0 and
+            std::chrono::steady_clock::now() - lastWriteTime_ >= writeInterval) {
+            writeMetrics_(false);
+        }
+    }
+}
+
+void MappingMetricsReporter::writeMetrics_(bool done) {
+    using std::chrono::duration;
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = duration<double>(now - startTime_).count();
+    double sinceLast = duration<double>(now - lastWriteTime_).count();
+
+    uint64_t numObserved = readExp_.numObservedFragments();
+    uint64_t numMapped = readExp_.numMappedFragments();
+    uint64_t numHits = readExp_.numFragHits();
+
+    std::vector<int64_t> depths;
+    for (auto& depth : queueDepths_) { depths.push_back(depth()); }
+
+    // Write to a temporary file and rename it, so that a reader never
+    // sees a partially written snapshot.
+    std::string tmpName = sfOpts_.metricsFile + ".tmp";
+    {
+        std::ofstream os(tmpName);
+        cereal::JSONOutputArchive oa(os);
+        oa(cereal::make_nvp("done", done));
+        oa(cereal::make_nvp("elapsed_seconds", elapsed));
+        oa(cereal::make_nvp("num_processed", numObserved));
+        oa(cereal::make_nvp("num_mapped", numMapped));
+        oa(cereal::make_nvp("percent_mapped",
+                    (numObserved > 0) ? (100.0 * numMapped) / numObserved : 0.0));
+        oa(cereal::make_nvp("hits_per_frag",
+                    (numObserved > 0) ? static_cast<double>(numHits) / numObserved : 0.0));
+        oa(cereal::make_nvp("frags_per_second",
+                    (elapsed > 0.0) ? numObserved / elapsed : 0.0));
+        oa(cereal::make_nvp("recent_frags_per_second",
+                    (sinceLast > 0.0) ? (numObserved - lastWriteFragments_) / sinceLast : 0.0));
+        oa(cereal::make_nvp("queues", queueNames_));
+        oa(cereal::make_nvp("queue_depths", depths));
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmpName, sfOpts_.metricsFile, ec);
+    if (ec) {
+        sfOpts_.jointLog->warn("Couldn't write the metrics file {}: {}",
+                               sfOpts_.metricsFile, ec.message());
+    }
+
+    lastWriteTime_ = now;
+    lastWriteFragments_ = numObserved;
+}
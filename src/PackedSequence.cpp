@@ -0,0 +1,167 @@
+#include "PackedSequence.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "UtilityFunctions.hpp"
+
+constexpr const char* PackedSequence::fileName;
+constexpr size_t PackedSequence::headerWords;
+
+namespace {
+
+constexpr uint64_t packedMagic{0x5346504b53455131ULL};
+constexpr uint64_t packedFormatVersion{2};
+
+} // anonymous namespace
+
+PackedSequence::PackedSequence(const char* s, size_t len) {
+    std::vector<std::pair<uint64_t, uint64_t>> nRuns;
+    for (size_t i = 0; i < len; ++i) {
+        if (nucleotideEncoding[static_cast<uint8_t>(s[i])] & invalidNucleotide) {
+            if (!nRuns.empty() and nRuns.back().first + nRuns.back().second == i) {
+                ++nRuns.back().second;
+            } else {
+                nRuns.emplace_back(i, 1);
+            }
+        }
+    }
+
+    // The header, the runs of Ns, then the bases
+    storage_.assign(headerWords + 2 * nRuns.size() + (len + 31) / 32, 0);
+    storage_[0] = packedMagic;
+    storage_[1] = packedFormatVersion;
+    storage_[2] = len;
+    storage_[3] = nRuns.size();
+    uint64_t* runs = storage_.data() + headerWords;
+    for (auto& run : nRuns) {
+        *runs++ = run.first;
+        *runs++ = run.second;
+    }
+    uint64_t* words = runs;
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t e = nucleotideEncoding[static_cast<uint8_t>(s[i])];
+        if (!(e & invalidNucleotide)) {
+            words[i >> 5] |= static_cast<uint64_t>(e & 0x3) << ((i & 0x1f) << 1);
+        }
+    }
+    setLayout_(storage_.data());
+}
+
+void PackedSequence::setLayout_(const uint64_t* data) {
+    size_ = data[2];
+    numRuns_ = data[3];
+    numWords_ = headerWords + 2 * numRuns_ + (size_ + 31) / 32;
+    runs_ = data + headerWords;
+    words_ = runs_ + 2 * numRuns_;
+}
+
+size_t PackedSequence::firstRunAfter_(size_t i) const {
+    size_t lo{0};
+    size_t hi = numRuns_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (runEnd_(mid) <= i) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool PackedSequence::hasN(size_t start, size_t len) const {
+    size_t r = firstRunAfter_(start);
+    return r < numRuns_ and runStart_(r) < start + len;
+}
+
+std::string PackedSequence::decode(size_t start, size_t len) const {
+    std::string s(len, 'A');
+    for (size_t i = 0; i < len; ++i) { s[i] = "ACGT"[code(start + i)]; }
+    for (size_t r = firstRunAfter_(start); r < numRuns_ and runStart_(r) < start + len; ++r) {
+        size_t b = std::max<size_t>(runStart_(r), start);
+        size_t e = std::min<size_t>(runEnd_(r), start + len);
+        std::fill(s.begin() + (b - start), s.begin() + (e - start), 'N');
+    }
+    return s;
+}
+
+/**
+ * C (01) and G (10) are the codes whose two bits differ, so each word
+ * is counted with one xor and a popcount.  Ns are stored as A, and are
+ * never counted.
+ */
+size_t PackedSequence::gcCount(size_t start, size_t len) const {
+    size_t count{0};
+    size_t end = start + len;
+    for (size_t i = start; i < end;) {
+        size_t lo = i & 0x1f;
+        size_t n = std::min<size_t>(32 - lo, end - i);
+        uint64_t w = words_[i >> 5];
+        uint64_t gc = ((w ^ (w >> 1)) & 0x5555555555555555ULL) >> (lo << 1);
+        if (n < 32) { gc &= (uint64_t(1) << (n << 1)) - 1; }
+        count += __builtin_popcountll(gc);
+        i += n;
+    }
+    return count;
+}
+
+uint32_t PackedSequence::kmerIndex(size_t i, uint32_t K,
+                                   sailfish::utils::Direction dir) const {
+    if (hasN(i, K)) { return std::numeric_limits<uint32_t>::max(); }
+    uint32_t idx{0};
+    if (dir == sailfish::utils::Direction::FORWARD) {
+        for (size_t j = i; j < i + K; ++j) { idx = (idx << 2) | code(j); }
+    } else {
+        for (size_t j = i + K; j > i; --j) { idx = (idx << 2) | (3 - code(j - 1)); }
+    }
+    return idx;
+}
+
+void PackedSequence::kmerIndices(size_t start, size_t numKmers, uint32_t K,
+                                 sailfish::utils::Direction dir,
+                                 std::vector<uint32_t>& idx,
+                                 std::vector<uint32_t>& codes) const {
+    size_t len = numKmers + K - 1;
+    bool rc = (dir == sailfish::utils::Direction::REVERSE_COMPLEMENT);
+    codes.resize(len);
+    for (size_t i = 0; i < len; ++i) {
+        uint32_t c = code(start + i);
+        codes[i] = rc ? 3 - c : c;
+    }
+    // An N is an 'A' in the forward direction already; its complement
+    // must be too
+    if (rc) {
+        for (size_t r = firstRunAfter_(start); r < numRuns_ and runStart_(r) < start + len; ++r) {
+            size_t b = std::max<size_t>(runStart_(r), start);
+            size_t e = std::min<size_t>(runEnd_(r), start + len);
+            std::fill(codes.begin() + (b - start), codes.begin() + (e - start), 0);
+        }
+    }
+    kmerIndicesFromCodes(codes, numKmers, K, rc, idx);
+}
+
+void PackedSequence::save(const std::string& path) const {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(runs_ - headerWords), sizeInBytes());
+    if (!ofs) {
+        throw std::runtime_error("Couldn't write the packed sequence to " + path);
+    }
+}
+
+void PackedSequence::load(const std::string& path) {
+    MappedFile m(path);
+    const uint64_t* data = static_cast<const uint64_t*>(m.data());
+    size_t numWords = m.size() / sizeof(uint64_t);
+    if (numWords < headerWords or data[0] != packedMagic or data[1] != packedFormatVersion or
+        data[3] > numWords or
+        m.size() != (headerWords + 2 * data[3] + (data[2] + 31) / 32) * sizeof(uint64_t)) {
+        throw std::runtime_error("The packed sequence " + path + " is invalid");
+    }
+    storage_.clear();
+    storage_.shrink_to_fit();
+    setLayout_(data);
+    mapping_ = std::move(m);
+}
@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "ReadStream.hpp"
+
+namespace sailfish {
+namespace io {
+
+namespace {
+
+using Chunk = std::vector<char>;
+
+// The size of a fixed BGZF block header (gzip header + the "BC" extra field)
+constexpr size_t bgzfHeaderSize{18};
+// The number of BGZF blocks handed to a decompression thread at once (~4MB)
+constexpr size_t bgzfBlocksPerTask{64};
+// The size of the chunks produced when inflating a regular gzip stream
+constexpr size_t inflateChunkSize{1 << 22};
+
+/**
+ * A simple bounded, blocking, multi-producer / multi-consumer queue.
+ * Once the queue is closed, push() fails and pop() drains whatever
+ * remains before failing.
+ */
+template <typename T>
+class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+        bool push(T&& v) {
+            std::unique_lock<std::mutex> l(mut_);
+            notFull_.wait(l, [this]() { return closed_ or q_.size() < capacity_; });
+            if (closed_) { return false; }
+            q_.push_back(std::move(v));
+            notEmpty_.notify_one();
+            return true;
+        }
+
+        bool pop(T& v) {
+            std::unique_lock<std::mutex> l(mut_);
+            notEmpty_.wait(l, [this]() { return closed_ or !q_.empty(); });
+            if (q_.empty()) { return false; }
+            v = std::move(q_.front());
+            q_.pop_front();
+            notFull_.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> l(mut_);
+            closed_ = true;
+            notFull_.notify_all();
+            notEmpty_.notify_all();
+        }
+
+    private:
+        size_t capacity_;
+        bool closed_{false};
+        std::deque<T> q_;
+        std::mutex mut_;
+        std::condition_variable notFull_;
+        std::condition_variable notEmpty_;
+};
+
+inline uint32_t readLE16(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8);
+}
+
+inline uint32_t readLE32(const unsigned char* p) {
+    return readLE16(p) | (readLE16(p + 2) << 16);
+}
+
+/**
+ * Returns the total size of the BGZF block beginning with the header
+ * `h`, or 0 if `h` is not a BGZF block header.
+ */
+size_t bgzfBlockSize(const char* h) {
+    auto u = reinterpret_cast<const unsigned char*>(h);
+    bool isBGZF = (u[0] == 0x1f and u[1] == 0x8b and u[2] == 8 and
+                   (u[3] & 0x04) and readLE16(u + 10) == 6 and
+                   u[12] == 'B' and u[13] == 'C' and readLE16(u + 14) == 2);
+    return isBGZF ? readLE16(u + 16) + 1 : 0;
+}
+
+/**
+ * Inflate a run of complete BGZF blocks.  blockEnds[i] is the offset one past
+ * the end of block i in `blocks`.  Each block is an independent gzip member
+ * whose uncompressed size is stored in its last 4 bytes, so the output can be
+ * sized up-front.
+ */
+Chunk inflateBGZFBlocks(const Chunk& blocks, const std::vector<size_t>& blockEnds) {
+    size_t total{0};
+    for (auto end : blockEnds) {
+        total += readLE32(reinterpret_cast<const unsigned char*>(&blocks[end - 4]));
+    }
+
+    Chunk out(total);
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+        throw std::runtime_error("Could not initialize zlib for BGZF decompression");
+    }
+
+    size_t outOffset{0};
+    size_t blockStart{0};
+    for (auto end : blockEnds) {
+        uint32_t isize = readLE32(reinterpret_cast<const unsigned char*>(&blocks[end - 4]));
+        // Empty blocks (e.g. the EOF marker block) have nothing to inflate,
+        // and zlib rejects an empty (possibly null) output buffer
+        if (isize == 0) {
+            blockStart = end;
+            continue;
+        }
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(&blocks[blockStart]));
+        zs.avail_in = end - blockStart;
+        zs.next_out = reinterpret_cast<Bytef*>(out.data() + outOffset);
+        zs.avail_out = isize;
+        int ret = inflate(&zs, Z_FINISH);
+        if (ret != Z_STREAM_END or zs.avail_out != 0) {
+            inflateEnd(&zs);
+            throw std::runtime_error("Corrupt BGZF block encountered while reading compressed reads");
+        }
+        inflateReset(&zs);
+        outOffset += isize;
+        blockStart = end;
+    }
+    inflateEnd(&zs);
+    return out;
+}
+
+/**
+ * A read-only stream buffer that decompresses a gzip stream ahead of the
+ * consumer.  A dedicated reader thread pulls compressed bytes from the
+ * underlying stream.  If the input is BGZF, batches of blocks are handed to
+ * a pool of worker threads and inflated concurrently; the resulting chunks
+ * are delivered to the consumer in their original order.  Otherwise, the
+ * reader thread inflates the (possibly multi-member) gzip stream itself.
+ */
+class ParallelGZipStreamBuf : public std::streambuf {
+    public:
+        ParallelGZipStreamBuf(std::unique_ptr<std::istream> src, uint32_t numThreads) :
+            src_(std::move(src)),
+            ready_(4 * std::max(numThreads, 1u)),
+            tasks_(4 * std::max(numThreads, 1u)) {
+            for (uint32_t i = 0; i < std::max(numThreads, 1u); ++i) {
+                workers_.emplace_back([this]() -> void { workLoop_(); });
+            }
+            reader_ = std::thread([this]() -> void { readLoop_(); });
+        }
+
+        ~ParallelGZipStreamBuf() {
+            ready_.close();
+            tasks_.close();
+            reader_.join();
+            for (auto& t : workers_) { t.join(); }
+        }
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) { return traits_type::to_int_type(*gptr()); }
+            std::future<Chunk> next;
+            do {
+                if (!ready_.pop(next)) { return traits_type::eof(); }
+                // Re-throws any error encountered during decompression
+                current_ = next.get();
+            } while (current_.empty());
+            setg(current_.data(), current_.data(), current_.data() + current_.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        size_t readUpTo_(char* buf, size_t n) {
+            src_->read(buf, n);
+            return static_cast<size_t>(src_->gcount());
+        }
+
+        bool pushReady_(Chunk&& c) {
+            std::promise<Chunk> p;
+            p.set_value(std::move(c));
+            return ready_.push(p.get_future());
+        }
+
+        void workLoop_() {
+            std::packaged_task<Chunk()> task;
+            while (tasks_.pop(task)) { task(); }
+        }
+
+        void readLoop_() {
+            try {
+                Chunk header(bgzfHeaderSize);
+                size_t n = readUpTo_(header.data(), bgzfHeaderSize);
+                header.resize(n);
+                if (n == bgzfHeaderSize and bgzfBlockSize(header.data()) > 0) {
+                    readBGZF_(header);
+                } else {
+                    inflateSequential_(header);
+                }
+            } catch (...) {
+                std::promise<Chunk> p;
+                p.set_exception(std::current_exception());
+                ready_.push(p.get_future());
+            }
+            ready_.close();
+            tasks_.close();
+        }
+
+        bool submitBlocks_(Chunk& blocks, std::vector<size_t>& blockEnds) {
+            if (blockEnds.empty()) { return true; }
+            std::packaged_task<Chunk()> task(
+                    std::bind(inflateBGZFBlocks, std::move(blocks), std::move(blockEnds)));
+            blocks = Chunk();
+            blockEnds = std::vector<size_t>();
+            // Queue the future first so that the consumer sees chunks in order
+            if (!ready_.push(task.get_future())) { return false; }
+            return tasks_.push(std::move(task));
+        }
+
+        /**
+         * `header` holds the (already read) header of the first block.
+         */
+        void readBGZF_(Chunk& header) {
+            Chunk blocks;
+            std::vector<size_t> blockEnds;
+            while (true) {
+                size_t blockSize = bgzfBlockSize(header.data());
+                if (blockSize == 0) {
+                    // A regular gzip member concatenated after BGZF data;
+                    // handle the remainder of the file sequentially.
+                    if (!submitBlocks_(blocks, blockEnds)) { return; }
+                    inflateSequential_(header);
+                    return;
+                }
+                size_t start = blocks.size();
+                blocks.resize(start + blockSize);
+                std::memcpy(&blocks[start], header.data(), bgzfHeaderSize);
+                size_t rest = blockSize - bgzfHeaderSize;
+                if (readUpTo_(&blocks[start + bgzfHeaderSize], rest) != rest) {
+                    throw std::runtime_error("Truncated BGZF file");
+                }
+                blockEnds.push_back(blocks.size());
+                if (blockEnds.size() == bgzfBlocksPerTask) {
+                    if (!submitBlocks_(blocks, blockEnds)) { return; }
+                    blocks.reserve(bgzfBlocksPerTask * (1 << 16));
+                }
+
+                header.resize(bgzfHeaderSize);
+                size_t n = readUpTo_(header.data(), bgzfHeaderSize);
+                if (n == 0) { break; }
+                if (n < bgzfHeaderSize) {
+                    throw std::runtime_error("Truncated BGZF file");
+                }
+            }
+            submitBlocks_(blocks, blockEnds);
+        }
+
+        /**
+         * Inflate a (possibly multi-member) gzip stream on this thread.
+         * `pending` holds any bytes already consumed from the source.
+         */
+        void inflateSequential_(Chunk& pending) {
+            z_stream zs;
+            std::memset(&zs, 0, sizeof(zs));
+            if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+                throw std::runtime_error("Could not initialize zlib for gzip decompression");
+            }
+            std::unique_ptr<z_stream, int(*)(z_streamp)> guard(&zs, inflateEnd);
+
+            Chunk in(std::max(pending.size(), size_t(1 << 20)));
+            std::copy(pending.begin(), pending.end(), in.begin());
+            zs.next_in = reinterpret_cast<Bytef*>(in.data());
+            zs.avail_in = pending.size();
+
+            Chunk out(inflateChunkSize);
+            size_t outSize{0};
+            bool inMember{zs.avail_in > 0};
+            while (true) {
+                if (zs.avail_in == 0) {
+                    size_t n = readUpTo_(in.data(), in.size());
+                    if (n == 0) {
+                        if (inMember) { throw std::runtime_error("Truncated gzip file"); }
+                        break;
+                    }
+                    zs.next_in = reinterpret_cast<Bytef*>(in.data());
+                    zs.avail_in = n;
+                    inMember = true;
+                }
+                zs.next_out = reinterpret_cast<Bytef*>(out.data() + outSize);
+                zs.avail_out = out.size() - outSize;
+                int ret = inflate(&zs, Z_NO_FLUSH);
+                outSize = out.size() - zs.avail_out;
+                if (ret == Z_STREAM_END) {
+                    // There may be another gzip member following this one;
+                    // if its first bytes are already buffered, we're in it
+                    inflateReset(&zs);
+                    inMember = (zs.avail_in > 0);
+                } else if (ret != Z_OK and ret != Z_BUF_ERROR) {
+                    throw std::runtime_error("Corrupt gzip file encountered while reading compressed reads");
+                }
+                if (outSize == out.size()) {
+                    out.resize(outSize);
+                    if (!pushReady_(std::move(out))) { return; }
+                    out = Chunk(inflateChunkSize);
+                    outSize = 0;
+                }
+            }
+            out.resize(outSize);
+            pushReady_(std::move(out));
+        }
+
+        std::unique_ptr<std::istream> src_;
+        BoundedQueue<std::future<Chunk>> ready_;
+        BoundedQueue<std::packaged_task<Chunk()>> tasks_;
+        std::vector<std::thread> workers_;
+        std::thread reader_;
+        Chunk current_;
+};
+
+class GZipReadStream : public std::istream {
+    public:
+        GZipReadStream(std::unique_ptr<std::istream> src, uint32_t numThreads) :
+            std::istream(nullptr), buf_(std::move(src), numThreads) {
+            rdbuf(&buf_);
+            // Propagate decompression errors to the parser
+            exceptions(std::ios_base::badbit);
+        }
+
+    private:
+        ParallelGZipStreamBuf buf_;
+};
+
+} // anonymous namespace
+
+bool isGZipped(std::istream& is) {
+    // Neither FASTA ('>') nor FASTQ ('@') can begin with the first byte
+    // of the gzip magic number, so one byte of look-ahead is sufficient.
+    return is.rdbuf()->sgetc() == 0x1f;
+}
+
+std::unique_ptr<std::istream> openReadStream(const std::string& fname,
+                                             uint32_t numDecompressionThreads) {
+    // Reopen stdin as a file so that it is read in large blocks (and in
+    // binary mode) like any other input, rather than through std::cin.
+    std::string path = (fname == stdinName) ? std::string("/dev/stdin") : fname;
+    std::unique_ptr<std::istream> raw(new std::ifstream(path, std::ios_base::in | std::ios_base::binary));
+    if (!*raw or !isGZipped(*raw)) { return raw; }
+    return std::unique_ptr<std::istream>(new GZipReadStream(std::move(raw), numDecompressionThreads));
+}
+
+} // namespace io
+} // namespace sailfish
@@ -54,7 +54,7 @@ int help(int argc, char* argv[]) {
   auto helpmsg = R"(
   ===============
 
-  Please invoke sailfish with one of the following commands {index, quant, sf}.
+  Please invoke sailfish with one of the following commands {index, quant, serve, sf}.
   For more information on the options for theses particular methods, use the -h
   flag along with the method name.  For example:
 
@@ -86,6 +86,7 @@ int mainSailfish(int argc, char* argv[]) {
 
 int mainIndex(int argc, char* argv[]);
 int mainQuantify(int argc, char* argv[]);
+int mainServe(int argc, char* argv[]);
 
 bool verbose = false;
 
@@ -97,7 +98,7 @@ int main( int argc, char* argv[] ) {
 
     po::options_description hidden("hidden");
     hidden.add_options()
-    ("command", po::value<string>(), "command to run {index, quant, sf}");
+    ("command", po::value<string>(), "command to run {index, quant, serve, sf}");
 
     po::options_description sfopts("Allowed Options");
     sfopts.add_options()
@@ -154,6 +155,7 @@ int main( int argc, char* argv[] ) {
     std::unordered_map<string, std::function<int(int, char*[])>> cmds({
       {"index", mainIndex},
       {"quant", mainQuantify},
+      {"serve", mainServe},
       {"sf", mainSailfish}
     });
 
@@ -60,9 +60,65 @@
 #include "RapMapSAIndex.hpp"
 #include "SailfishUtils.hpp"
 #include "SailfishIndex.hpp"
+#include "TranscriptPanel.hpp"
+#include "ReadStream.hpp"
 #include "spdlog/spdlog.h"
 #include "spdlog/details/format.h"
 
+/**
+ * Concatenate the (possibly gzipped) transcript files into the single,
+ * uncompressed FASTA file outFasta, decompressing with numThreads threads.
+ */
+void mergeTranscriptFiles(const std::vector<std::string>& transcriptFiles,
+                          const std::string& outFasta,
+                          uint32_t numThreads) {
+    std::ofstream ofs(outFasta, std::ios::binary);
+    std::vector<char> buffer(1 << 20);
+    for (auto& fname : transcriptFiles) {
+        auto is = sailfish::io::openReadStream(fname, numThreads);
+        if (!is or !(*is)) {
+            throw std::invalid_argument("Couldn't open the transcript file " + fname);
+        }
+        char last = '\n';
+        while (*is) {
+            is->read(buffer.data(), buffer.size());
+            std::streamsize n = is->gcount();
+            if (n > 0) {
+                ofs.write(buffer.data(), n);
+                last = buffer[n - 1];
+            }
+        }
+        // Don't let the last record of one file run into the next one
+        if (last != '\n') { ofs.put('\n'); }
+    }
+    if (!ofs) {
+        throw std::invalid_argument("Couldn't write the transcripts to " + outFasta);
+    }
+}
+
+/**
+ * Intermediate files of the index build, which are removed when it is
+ * done (or fails).
+ */
+class TemporaryFiles {
+  public:
+    explicit TemporaryFiles(const boost::filesystem::path& dir) : dir_(dir) {}
+    ~TemporaryFiles() {
+        boost::system::error_code ec;
+        for (auto& p : paths_) { boost::filesystem::remove(p, ec); }
+    }
+
+    // A new, unique path in dir for a file with the given suffix
+    std::string add(const std::string& suffix) {
+        paths_.push_back(dir_ / boost::filesystem::unique_path("tmp-%%%%-%%%%-%%%%" + suffix));
+        return paths_.back().string();
+    }
+
+  private:
+    boost::filesystem::path dir_;
+    std::vector<boost::filesystem::path> paths_;
+};
+
 int mainIndex( int argc, char *argv[] ) {
     using std::string;
     namespace po = boost::program_options;
@@ -80,6 +136,15 @@ int mainIndex( int argc, char *argv[] ) {
     ("out,o", po::value<string>()->required(), "Output stem [all files needed by Sailfish will be of the form stem.*].")
     ("threads,p", po::value<uint32_t>()->default_value(maxThreads), "The number of threads to use concurrently.")
     ("force,f", po::bool_switch(), "" )
+    ("filterBits", po::value<uint32_t>()->default_value(16), "The number of bits per k-mer in the "
+        "k-mer filter stored with the index, which lets quant reject reads that can't map without "
+        "searching the index.  More bits mean fewer false positives, but a larger filter.  If 0, no "
+        "filter is built.")
+    ("panel", po::value<string>(), "A file listing the names of the transcripts (one per line) of a "
+        "targeted panel.  If given, only these transcripts, and the other transcripts that share a k-mer "
+        "with one of them, are indexed.  Reads from transcripts outside of the panel that resemble it are "
+        "then still assigned to those transcripts, while the index (and the quantification) are much "
+        "smaller than for the whole transcriptome.")
     ;
 
     po::variables_map vm;
@@ -105,23 +170,25 @@ Builds a Sailfish index
         std::vector<string> transcriptFiles = vm["transcripts"].as<std::vector<string>>();
         uint32_t numThreads = vm["threads"].as<uint32_t>();
         bool force = vm["force"].as<bool>();
+        uint32_t filterBits = vm["filterBits"].as<uint32_t>();
 
         // Check to make sure that the specified output directory either doesn't exist, or is
         // a valid path (e.g. not a file)
         namespace bfs = boost::filesystem;
 
-        // Ensure that the transcript file provided by the user exists
-        auto txpFile = transcriptFiles.front();
-        if (!bfs::exists(txpFile)) {
-            std::cerr << "The provided transcript file [" << txpFile << "] does not seem to exist!\n";
-            std::cerr << "Please check that the correct path was provided.\n";
-            std::exit(1);
-        }
-        // and that it is, in fact, a file
-        if (bfs::is_directory(txpFile)) {
-            std::cerr << "The provided transcript file [" << txpFile << "] appears to be a directory!\n";
-            std::cerr << "Please check that the correct path was provided.\n";
-            std::exit(1);
+        // Ensure that the transcript files provided by the user exist
+        for (auto& txpFile : transcriptFiles) {
+            if (!bfs::exists(txpFile)) {
+                std::cerr << "The provided transcript file [" << txpFile << "] does not seem to exist!\n";
+                std::cerr << "Please check that the correct path was provided.\n";
+                std::exit(1);
+            }
+            // and that they are, in fact, files
+            if (bfs::is_directory(txpFile)) {
+                std::cerr << "The provided transcript file [" << txpFile << "] appears to be a directory!\n";
+                std::cerr << "Please check that the correct path was provided.\n";
+                std::exit(1);
+            }
         }
 
         // Check that the output path doesn't exist yet (or at least is not a file)
@@ -202,15 +269,53 @@ Builds a Sailfish index
                 return 1;
             }
 
-            fmt::MemoryWriter optWriter;
-            optWriter << merLen;
-            argVec.push_back(optWriter.str().c_str());
+            // argVec only points to these strings, so they must outlive the build
+            std::string merLenStr = std::to_string(merLen);
+            argVec.push_back(merLenStr.c_str());
+
+            // The quasi-index is built from a single, uncompressed FASTA file,
+            // so several (or gzipped) transcript files are merged into one
+            // first.  The index doesn't need the merged (or panel) FASTA
+            // once it is built, so those are only kept until then.
+            TemporaryFiles tmpFiles(outputPath);
+            std::string txpFile = transcriptFiles.front();
+            bool isGZipped{false};
+            {
+                std::ifstream ifs(txpFile);
+                isGZipped = sailfish::io::isGZipped(ifs);
+            }
+            if (transcriptFiles.size() > 1 or isGZipped) {
+                txpFile = tmpFiles.add("_transcripts.fa");
+                jointLog->info("Merging {} transcript file(s) into {}",
+                               transcriptFiles.size(), txpFile);
+                mergeTranscriptFiles(transcriptFiles, txpFile, numThreads);
+            }
+
+            // For a panel, only the panel transcripts and their
+            // neighbours are written out and indexed
+            std::string indexedTxpFile = txpFile;
+            if (vm.count("panel")) {
+                std::string panelFile = vm["panel"].as<string>();
+                indexedTxpFile = tmpFiles.add("_panel_transcripts.fa");
+                jointLog->info("Selecting the transcripts of the panel {}", panelFile);
+                auto summary = sailfish::panel::writePanelTranscriptome(
+                        txpFile, panelFile, merLen, indexedTxpFile);
+                jointLog->info("Indexing {} panel transcripts and {} transcripts "
+                               "that share k-mers with them",
+                               summary.numPanel, summary.numNeighbours);
+                if (!summary.missing.empty()) {
+                    jointLog->warn("{} transcripts of the panel (e.g. {}) weren't found in {}",
+                                   summary.missing.size(), summary.missing.front(),
+                                   txpFile);
+                }
+            }
             argVec.push_back("-t");
-            argVec.push_back(transcriptFiles.front().c_str());
+            argVec.push_back(indexedTxpFile.c_str());
+            std::string outputDir = outputPath.string();
             argVec.push_back("-i");
-            argVec.push_back(outputPath.string().c_str());
+            argVec.push_back(outputDir.c_str());
             SailfishIndex sidx(jointLog);
-            sidx.build(outputPath, argVec, merLen);
+            sidx.build(outputPath, argVec, merLen, filterBits, numThreads);
         } else {
             std::cerr << "All index files seem up-to-date.\n";
             std::cerr << "To force Sailfish to rebuild the index, use the --force option.\n";
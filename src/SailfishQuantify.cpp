@@ -25,8 +25,6 @@
 
 // Jellyfish 2 include
 #include "jellyfish/mer_dna.hpp"
-#include "jellyfish/stream_manager.hpp"
-#include "jellyfish/whole_sequence_parser.hpp"
 
 //#include "BiasIndex.hpp"
 #include "VersionChecker.hpp"
@@ -37,6 +35,8 @@
 #include "CollapsedEMOptimizer.hpp"
 #include "CollapsedGibbsSampler.hpp"
 #include "ReadLibrary.hpp"
+#include "PairSequenceParser.hpp"
+#include "SingleSequenceParser.hpp"
 #include "RapMapUtils.hpp"
 #include "HitManager.hpp"
 #include "SASearcher.hpp"
@@ -44,6 +44,13 @@
 #include "EmpiricalDistribution.hpp"
 #include "TextBootstrapWriter.hpp"
 #include "GZipWriter.hpp"
+#include "MappingMetrics.hpp"
+#include "ReadMappingCache.hpp"
+#include "ReadBucketing.hpp"
+#include "AnchorPrefetcher.hpp"
+#include "KmerBloomFilter.hpp"
+#include "SortedIntersection.hpp"
+#include "SailfishServer.hpp"
 //#include "HDF5Writer.hpp"
 
 #include "spdlog/spdlog.h"
@@ -60,8 +67,7 @@ using QuasiAlignment = rapmap::utils::QuasiAlignment;
 /****** Parser aliases ***/
 //using paired_parser = pair_sequence_parser<std::vector<std::ifstream*>::iterator>;
 using paired_parser = pair_sequence_parser<char**>;//std::vector<std::ifstream*>::iterator>;
-using stream_manager = jellyfish::stream_manager<std::vector<std::string>::const_iterator>;
-using single_parser = jellyfish::whole_sequence_parser<stream_manager>;
+using single_parser = single_sequence_parser<char**>;
 /****** Parser aliases ***/
 
 
@@ -72,6 +78,63 @@ using std::string;
 
 constexpr uint32_t readGroupSize{1000};
 
+/**
+ * A single thread's view of a sample budget (e.g. the number of fragment
+ * lengths or bias samples to collect) that is shared by all threads.
+ * Samples are claimed from the shared counter in blocks, so the counter
+ * isn't written for every sample, and the total number of samples taken
+ * never exceeds the budget.  Claimed samples that aren't used are given
+ * back by release(), so that afterwards the shared counter holds exactly
+ * the number of samples that weren't taken.
+ */
+class SampleBudget {
+    public:
+        SampleBudget(std::atomic<int32_t>& shared, int32_t blockSize) :
+            shared_(shared), blockSize_(blockSize) {}
+
+        ~SampleBudget() { release(); }
+
+        /**
+         * Returns true if this thread may take another sample.
+         */
+        inline bool available() {
+            if (local_ > 0) { return true; }
+            int32_t cur = shared_.load();
+            while (cur > 0) {
+                int32_t n = std::min(blockSize_, cur);
+                if (shared_.compare_exchange_weak(cur, cur - n)) {
+                    local_ = n;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * Record that a sample was taken; available() must have returned true.
+         */
+        inline void consume() { --local_; }
+
+        /**
+         * Take a sample if one is available.
+         */
+        inline bool claim() {
+            if (!available()) { return false; }
+            consume();
+            return true;
+        }
+
+        void release() {
+            if (local_ > 0) { shared_ += local_; }
+            local_ = 0;
+        }
+
+    private:
+        std::atomic<int32_t>& shared_;
+        int32_t blockSize_;
+        int32_t local_{0};
+};
+
 /**
  * Compute and return the mean fragment length ---
  * rounded down to the nearest integer --- of the fragment
@@ -97,12 +160,139 @@ int32_t getMeanFragLen(const FragLengthCountMap& flMap) {
     return static_cast<uint32_t>(ret);
 }
 
+/**
+ * Count a fragment whose mapping was found in the read cache exactly as
+ * if it had just been mapped.  flBudget and flMap are null for single-end
+ * reads.
+ */
+void applyCachedMapping(const ReadMappingResult& m,
+                        std::vector<uint32_t>& txpIDs,
+                        EquivalenceClassAccumulator& eqBuilder,
+                        MappingCounters& counters,
+                        SampleBudget* flBudget,
+                        std::vector<uint32_t>* flMap) {
+    counters.upperBoundHits += m.hadHits ? 1 : 0;
+    if (m.numTxps > 0) {
+        txpIDs.assign(m.txps, m.txps + m.numTxps);
+        eqBuilder.addGroup(txpIDs);
+        counters.numFwd += m.numFwd;
+        counters.numRC += m.numRC;
+        ++counters.numMappedFragments;
+    }
+    if (flMap and m.fragLen >= 0 and flBudget->claim()) {
+        (*flMap)[m.fragLen]++;
+    }
+    counters.numFragHits += m.numHits;
+    ++counters.numObservedFragments;
+}
+
+/**
+ * Before a strict merge of the left and right hits of a fragment, removes
+ * the hits on transcripts that the other mate didn't hit, so that the
+ * merge only has to visit the hits that will be paired.  The transcript
+ * IDs are copied into packed arrays and intersected with
+ * sailfish::intersection::intersectSorted.  Both hit lists must be sorted
+ * by transcript, as the merge also requires.
+ */
+class SharedTranscriptFilter {
+  public:
+    // Below this many hits in total, the merge is run directly
+    static constexpr size_t minHits{32};
+
+    /**
+     * Returns false, leaving the hits unchanged, if the mates share more
+     * than maxNumHits transcripts (so that the fragment will be discarded).
+     */
+    bool operator()(std::vector<QuasiAlignment>& leftHits,
+                    std::vector<QuasiAlignment>& rightHits,
+                    size_t maxNumHits) {
+        packIDs_(leftHits, leftIDs_);
+        packIDs_(rightHits, rightIDs_);
+        size_t maxShared = std::min(leftHits.size(), rightHits.size()) + 1;
+        leftShared_.resize(maxShared);
+        rightShared_.resize(maxShared);
+        size_t numShared = sailfish::intersection::intersectSorted(
+                leftIDs_.data(), leftIDs_.size(),
+                rightIDs_.data(), rightIDs_.size(),
+                leftShared_.data(), rightShared_.data(), maxNumHits);
+        if (numShared > maxNumHits) { return false; }
+        keep_(leftHits, leftShared_, numShared);
+        keep_(rightHits, rightShared_, numShared);
+        return true;
+    }
+
+  private:
+    static void packIDs_(const std::vector<QuasiAlignment>& hits,
+                         std::vector<uint32_t>& ids) {
+        ids.resize(hits.size());
+        for (size_t i = 0; i < hits.size(); ++i) { ids[i] = hits[i].transcriptID(); }
+    }
+
+    // The kept indices are increasing, so the hits can be moved in place
+    static void keep_(std::vector<QuasiAlignment>& hits,
+                      const std::vector<uint32_t>& keep, size_t numKept) {
+        for (size_t i = 0; i < numKept; ++i) {
+            if (keep[i] != i) { hits[i] = hits[keep[i]]; }
+        }
+        hits.resize(numKept);
+    }
+
+    std::vector<uint32_t> leftIDs_;
+    std::vector<uint32_t> rightIDs_;
+    std::vector<uint32_t> leftShared_;
+    std::vector<uint32_t> rightShared_;
+};
+
+/**
+ * Decides, before the index is searched, whether a read (or mate) could
+ * map.  It can't if none of its k-mers are in the index's k-mer filter, and
+ * it isn't worth mapping if its DUST score is above --maxDustScore.  The
+ * k-mer filter is checked first, since mappable reads usually pass it at
+ * the first k-mer.
+ */
+class ReadPrefilter {
+  public:
+    ReadPrefilter(const KmerBloomFilter* kmerFilter, double maxDustScore) :
+        kmerFilter_(kmerFilter), maxDustScore_(maxDustScore) {}
+
+    bool operator()(const std::string& seq, MappingCounters& counters) const {
+        if (kmerFilter_ and !kmerFilter_->mayContainAnyKmer(seq.data(), seq.size())) {
+            ++counters.numKmerFiltered;
+            return false;
+        }
+        if (maxDustScore_ > 0.0 and dustScore(seq.data(), seq.size()) > maxDustScore_) {
+            ++counters.numLowComplexity;
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    const KmerBloomFilter* kmerFilter_;
+    double maxDustScore_;
+};
+
+/**
+ * The options that are checked for every hit, as compile-time constants,
+ * so that processReadsQuasi can be specialized on them; the version to use
+ * is chosen once per library in processLibraryQuasi.
+ */
+template <bool IgnoreCompat, bool EnforceCompat, bool CollectBias>
+struct HitOptions {
+    // Treat every hit as compatible with the library type
+    static constexpr bool ignoreCompat = IgnoreCompat;
+    // Never fall back to incompatible hits
+    static constexpr bool enforceCompat = EnforceCompat;
+    // Sequence or GC bias samples are needed
+    static constexpr bool collectBias = CollectBias;
+};
+
 /**
  * For paired-end reads:
  * Do the main work of mapping the reads and building
  * the equivalence classes.
  */
-template <typename IndexT>
+template <typename IndexT, typename HitOptionsT>
 void processReadsQuasi(paired_parser* parser,
                IndexT* sidx,
                ReadExperiment& readExp,
@@ -110,57 +300,77 @@ void processReadsQuasi(paired_parser* parser,
                SailfishOpts& sfOpts,
                FragLengthCountMap& flMap,
                std::atomic<int32_t>& remainingFLOps,
+               ReadMappingCache* readCache,
 	           std::mutex& iomutex) {
 
   uint32_t maxFragLen = sfOpts.maxFragLen;
-  uint64_t prevObservedFrags{1};
   uint64_t leftHitCount{0};
   uint64_t hitListCount{0};
-  int32_t meanFragLen{-1};
 
-  size_t locRead{0};
   uint64_t localUpperBoundHits{0};
 
   bool tooManyHits{false};
   size_t maxNumHits{sfOpts.maxReadOccs};
   size_t readLen{0};
 
-  auto& numObservedFragments = readExp.numObservedFragmentsAtomic();
-  auto& validHits = readExp.numMappedFragmentsAtomic();
-  auto& totalHits = readExp.numFragHitsAtomic();
-  auto& upperBoundHits = readExp.upperBoundHitsAtomic();
-  auto& eqBuilder = readExp.equivalenceClassBuilder();
+  // Counts for this thread; added to the totals after every batch
+  MappingCounters counters;
+  // The result of mapping the current fragment, as stored in the read cache
+  ReadMappingResult mapping;
+  ReadMappingCache::Key cacheKey;
+  // The key of the next fragment, whose cache slot is prefetched while
+  // the current one is mapped
+  ReadMappingCache::Key nextCacheKey;
+  // If the reads are bucketed, the order in which they're mapped
+  std::unique_ptr<ReadBucketer> bucketer{nullptr};
+  if (sfOpts.bucketWindow > 0) { bucketer.reset(new ReadBucketer()); }
+  // Equivalence class counts are gathered locally and merged in batches
+  EquivalenceClassAccumulator eqBuilder(readExp.equivalenceClassBuilder());
   auto& transcripts = readExp.transcripts();
 
-  auto& readBias = readExp.readBias();
-  auto& observedGC = readExp.observedGC();
-  bool estimateGCBias = sfOpts.gcBiasCorrect;
+  // The bias, GC and fragment length observations of this thread are
+  // collected locally and added to the shared ones when it is done.
+  ReadKmerDist<6, uint32_t> readBias;
+  std::vector<uint32_t> observedGC(readExp.observedGC().size(), 0);
+  std::vector<uint32_t> localFLMap(flMap.size(), 0);
+  SampleBudget biasBudget(sfOpts.numBiasSamples, 256);
+  SampleBudget flBudget(remainingFLOps, 16);
+  bool estimateGCBias = HitOptionsT::collectBias and sfOpts.gcBiasCorrect;
   bool strictIntersect = sfOpts.strictIntersect;
   bool discardOrphans = !sfOpts.allowOrphans;
 
   SACollector<IndexT> hitCollector(sidx);
   SASearcher<IndexT> saSearcher(sidx);
+  // Loads the index entries of the next fragments' first k-mers ahead
+  // of their search
+  AnchorPrefetcher<IndexT> anchorPrefetcher(sidx);
+  bool prefetchAnchors = sfOpts.prefetchAnchors;
   rapmap::utils::HitCounters hctr;
 
   std::vector<QuasiAlignment> leftHits;
   std::vector<QuasiAlignment> rightHits;
   std::vector<QuasiAlignment> jointHits;
+  SharedTranscriptFilter sharedFilter;
+  ReadPrefilter prefilter(readExp.getIndex()->kmerFilter(), sfOpts.maxDustScore);
+
+  // The hit collector takes a std::string, so the read sequences
+  // are copied out of the batch arena into these reusable buffers.
+  std::string leftSeq;
+  std::string rightSeq;
 
   std::vector<uint32_t> txpIDsAll;
-  std::vector<double> auxProbsAll;
 
   std::vector<uint32_t> txpIDsCompat;
-  std::vector<double> auxProbsCompat;
 
   // *Completely* ignore strandedness information
-  bool ignoreCompat = sfOpts.ignoreLibCompat;
+  constexpr bool ignoreCompat = HitOptionsT::ignoreCompat;
   // Don't *strictly* enforce compatibility --- if
   // the only hits are incompatible with the library
   // type then allow them.
-  bool enforceCompat = sfOpts.enforceLibCompat;
+  constexpr bool enforceCompat = HitOptionsT::enforceCompat;
   // True when we have compatible hits, false otherwise
   bool haveCompat{false};
-  auto expectedLibType = rl.format();
+  sailfish::utils::LibraryCompatibility libCompat(rl.format());
 
   bool canDovetail = sfOpts.allowDovetail;
 
@@ -175,36 +385,94 @@ void processReadsQuasi(paired_parser* parser,
   while(true) {
     typename paired_parser::job j(*parser); // Get a job from the parser: a bunch of read (at most max_read_group)
     if(j.is_empty()) break;           // If got nothing, quit
+    parser->batch_consumed();
+
+    const std::vector<uint32_t>* order = bucketer ? &bucketer->order(*j) : nullptr;
+    for(size_t r = 0; r < j->nb_filled; ++r) { // For all the read in this batch
+        size_t i = order ? (*order)[r] : r;
+        auto& leftRec = j->data[i].first;
+        auto& rightRec = j->data[i].second;
+        leftSeq.assign(j->bytes(leftRec.seq_off), leftRec.seq_len);
+        rightSeq.assign(j->bytes(rightRec.seq_off), rightRec.seq_len);
+        readLen = leftRec.seq_len;
+
+        // If this exact pair was mapped before, reuse the result
+        if (readCache) {
+            cacheKey = (r == 0) ? ReadMappingCache::keyFor(leftSeq, rightSeq) : nextCacheKey;
+            if (r + 1 < j->nb_filled) {
+                auto& next = j->data[order ? (*order)[r + 1] : r + 1];
+                nextCacheKey = ReadMappingCache::keyFor(
+                        j->bytes(next.first.seq_off), next.first.seq_len,
+                        j->bytes(next.second.seq_off), next.second.seq_len);
+                readCache->prefetch(nextCacheKey);
+            }
+            ++counters.numCacheLookups;
+            if (readCache->lookup(cacheKey, mapping)) {
+                ++counters.numCacheHits;
+                applyCachedMapping(mapping, txpIDsCompat, eqBuilder, counters,
+                                   &flBudget, &localFLMap);
+                continue;
+            }
+            mapping.clear();
+        }
 
-    for(size_t i = 0; i < j->nb_filled; ++i) { // For all the read in this batch
-        readLen = j->data[i].first.seq.length();
         tooManyHits = false;
         jointHits.clear();
         leftHits.clear();
         rightHits.clear();
         txpIDsAll.clear();
-        auxProbsAll.clear();
         txpIDsCompat.clear();
-        auxProbsCompat.clear();
         haveCompat = false;
         mappedFrag = false;
 
-        bool lh = hitCollector(j->data[i].first.seq,
-                               leftHits, saSearcher,
-                               MateStatus::PAIRED_END_LEFT,
-							   true // strict check
-							   );
+        bool lh{false};
+        if (prefilter(leftSeq, counters)) {
+            // The hash buckets of the fragment after next, then the suffix
+            // array intervals of the next one (whose buckets were loaded
+            // while the last fragment was mapped)
+            if (prefetchAnchors and r + 2 < j->nb_filled) {
+                auto& ahead = j->data[order ? (*order)[r + 2] : r + 2];
+                anchorPrefetcher.prefetchBucket(j->bytes(ahead.first.seq_off), ahead.first.seq_len);
+                anchorPrefetcher.prefetchBucket(j->bytes(ahead.second.seq_off), ahead.second.seq_len);
+            }
+            if (prefetchAnchors and r + 1 < j->nb_filled) {
+                auto& next = j->data[order ? (*order)[r + 1] : r + 1];
+                anchorPrefetcher.prefetchInterval(j->bytes(next.first.seq_off), next.first.seq_len);
+                anchorPrefetcher.prefetchInterval(j->bytes(next.second.seq_off), next.second.seq_len);
+            }
+            lh = hitCollector(leftSeq,
+                              leftHits, saSearcher,
+                              MateStatus::PAIRED_END_LEFT,
+                              true // strict check
+                              );
+        }
 
-        bool rh = hitCollector(j->data[i].second.seq,
-                               rightHits, saSearcher,
-                               MateStatus::PAIRED_END_RIGHT,
-							   true // strict check
-							   );
+        // If the left mate has no hits, then the right mate's hits can
+        // only be used as orphans; when they can't be (a strict merge, or
+        // orphans are discarded anyway), don't search for them at all.
+        bool rh{false};
+        if (!leftHits.empty() or (!strictIntersect and !discardOrphans)) {
+            if (prefilter(rightSeq, counters)) {
+                rh = hitCollector(rightSeq,
+                                  rightHits, saSearcher,
+                                  MateStatus::PAIRED_END_RIGHT,
+                                  true // strict check
+                                  );
+            }
+        } else {
+            ++counters.numMateSearchesSkipped;
+        }
 
         if (strictIntersect) {
-          rapmap::utils::mergeLeftRightHits(
-              leftHits, rightHits, jointHits,
-              readLen, maxNumHits, tooManyHits, hctr);
+          bool filter = !leftHits.empty() and !rightHits.empty() and
+                        leftHits.size() + rightHits.size() >= SharedTranscriptFilter::minHits;
+          if (filter and !sharedFilter(leftHits, rightHits, maxNumHits)) {
+              tooManyHits = true;
+          } else {
+              rapmap::utils::mergeLeftRightHits(
+                  leftHits, rightHits, jointHits,
+                  readLen, maxNumHits, tooManyHits, hctr);
+          }
         } else {
           rapmap::utils::mergeLeftRightHitsFuzzy(
               lh, rh,
@@ -212,9 +480,16 @@ void processReadsQuasi(paired_parser* parser,
               readLen, maxNumHits, tooManyHits, hctr);
         }
 
-        upperBoundHits += (jointHits.size() > 0);
+        bool upperBound = (jointHits.size() > 0);
+        counters.upperBoundHits += upperBound;
 
-        if (jointHits.size() > sfOpts.maxReadOccs ) { jointHits.clear(); }
+        // The merge stops early (and sets tooManyHits) once it's certain
+        // that the fragment has more than maxReadOccs mappings, in which
+        // case it is discarded.
+        if (tooManyHits or jointHits.size() > maxNumHits) {
+            ++counters.numTooManyHits;
+            jointHits.clear();
+        }
 
         if (jointHits.size() > 0) {
             // Are the jointHits paired-end quasi-mappings or orphans?
@@ -250,10 +525,8 @@ void processReadsQuasi(paired_parser* parser,
             int32_t rcAll = 0;
             int32_t rcCompat = 0;
 
-            double auxSumAll = 0.0;
-            double auxSumCompat = 0.0;
-            bool needBiasSample = sfOpts.biasCorrect;
-            bool needGCSample = sfOpts.gcBiasCorrect;
+            bool needBiasSample = HitOptionsT::collectBias and sfOpts.biasCorrect;
+            bool needGCSample = HitOptionsT::collectBias and sfOpts.gcBiasCorrect;
 
 	    //auto sampleIndex = dis(gen) % jointHits.size();
 	    size_t hitIndex{0};
@@ -267,36 +540,27 @@ void processReadsQuasi(paired_parser* parser,
                 // If bias correction is turned on, and we haven't sampled a mapping
                 // for this read yet, and we haven't collected the required number of
                 // samples overall.
-                if(needBiasSample and sfOpts.numBiasSamples > 0){
+                if(needBiasSample and biasBudget.available()){
                     // the "start" position is the leftmost position if
                     // we hit the forward strand, and the leftmost
                     // position + the read length if we hit the reverse complement
                     int32_t startPos = h.fwd ? pos : pos + h.readLen;
 
                     if (startPos > 0 and startPos < txp.RefLength) {
-                        const char* txpStart = txp.Sequence();
-                        const char* readStart = txpStart + startPos;
-                        const char* txpEnd = txpStart+ txp.RefLength;
-
-                        bool success = readBias.update(txpStart, readStart, txpEnd, dir);
+                        bool success = readBias.update(txp.Sequence(), startPos, dir);
                         if (success) {
-                            sfOpts.numBiasSamples -= 1;
+                            biasBudget.consume();
                             needBiasSample = false;
                         }
                     }
                 }
 
                 if (!isPaired) {
-                    if (remainingFLOps <= 0 and meanFragLen < 0) {
-                        meanFragLen = getMeanFragLen(flMap);
-                    }
                     // True if the read is compatible with the
                     // expected library type; false otherwise.
                     bool compat = ignoreCompat;
                     if (!compat) {
-                        compat = sailfish::utils::compatibleHit(
-                                expectedLibType, pos,
-                                h.fwd, h.mateStatus);
+                        compat = libCompat.compatible(h.mateStatus, h.fwd);
                     }
 
 
@@ -327,14 +591,10 @@ void processReadsQuasi(paired_parser* parser,
                         if (compat) {
                             haveCompat = true;
                             txpIDsCompat.push_back(transcriptID);
-                            auxProbsCompat.push_back(1.0);
-                            auxSumCompat += 1.0;
                             if (fwdHit) { fwCompat++; } else { rcCompat++; }
                         }
                         if (!haveCompat and !enforceCompat) {
                             txpIDsAll.push_back(transcriptID);
-                            auxProbsAll.push_back(1.0);
-                            auxSumAll += 1.0;
                             if (fwdHit) { fwAll++; } else { rcAll++; }
                         }
                     }
@@ -344,11 +604,10 @@ void processReadsQuasi(paired_parser* parser,
                         uint32_t end1Pos = (h.fwd) ? h.pos : h.pos + h.readLen;
                         uint32_t end2Pos = (h.mateIsFwd) ? h.matePos : h.matePos + h.mateLen;
                         auto observedLibType =
-                            sailfish::utils::hitType(end1Pos, h.fwd, h.readLen,
+                            sailfish::utils::hitTypeID(end1Pos, h.fwd, h.readLen,
                                     end2Pos, h.mateIsFwd,
                                     h.mateLen, canDovetail);
-                        compat = sailfish::utils::compatibleHit(
-                                expectedLibType, observedLibType);
+                        compat = libCompat.compatible(observedLibType);
                     }
 
                     bool fwdHit {h.fwd};
@@ -356,14 +615,10 @@ void processReadsQuasi(paired_parser* parser,
                     if (compat) {
                         haveCompat = true;
                         txpIDsCompat.push_back(transcriptID);
-                        auxProbsCompat.push_back(1.0);
-                        auxSumCompat += 1.0;
                         if (fwdHit) { fwCompat++; } else { rcCompat++; }
                     }
                     if (!haveCompat and !enforceCompat) {
                         txpIDsAll.push_back(transcriptID);
-                        auxProbsAll.push_back(1.0);
-                        auxSumAll += 1.0;
                         if (fwdHit) { fwAll++; } else { rcAll++; }
                     }
                 }
@@ -392,26 +647,26 @@ void processReadsQuasi(paired_parser* parser,
 		++hitIndex;
 	    }
 
-            // NOTE: Normalize auxProbs here if we end up
-            // using these weights.
+            // NOTE: All hits of a fragment are weighted equally, so
+            // no weights are recorded here; see EquivalenceClassBuilder::finish().
 
             // If we have compatible hits, only use those
             if (haveCompat) {
                 if (txpIDsCompat.size() > 0) {
                     mappedFrag = true;
-                    TranscriptGroup tg(txpIDsCompat);
-                    eqBuilder.addGroup(std::move(tg), auxProbsCompat);
-                    readExp.addNumFwd(fwCompat);
-                    readExp.addNumRC(rcCompat);
+                    eqBuilder.addGroup(txpIDsCompat);
+                    counters.numFwd += fwCompat;
+                    counters.numRC += rcCompat;
+                    if (readCache) { mapping.setClass(txpIDsCompat, fwCompat, rcCompat); }
                 }
             } else {
                 if (txpIDsAll.size() > 0) {
                     // Otherwise, consider all hits.
                     mappedFrag = true;
-                    TranscriptGroup tg(txpIDsAll);
-                    eqBuilder.addGroup(std::move(tg), auxProbsAll);
-                    readExp.addNumFwd(fwAll);
-                    readExp.addNumRC(rcAll);
+                    eqBuilder.addGroup(txpIDsAll);
+                    counters.numFwd += fwAll;
+                    counters.numRC += rcAll;
+                    if (readCache) { mapping.setClass(txpIDsAll, fwAll, rcAll); }
                 }
             }
         }
@@ -423,31 +678,39 @@ void processReadsQuasi(paired_parser* parser,
             bool isPaired = h.mateStatus == rapmap::utils::MateStatus::PAIRED_END_PAIRED;
 
             // This is a unique hit
-            if (isPaired and remainingFLOps > 0) {
-                if (mappedFrag and h.fragLen < maxFragLen) {
-                    flMap[h.fragLen]++;
-                    remainingFLOps--;
+            if (isPaired and mappedFrag and h.fragLen < maxFragLen) {
+                mapping.fragLen = h.fragLen;
+                if (flBudget.claim()) {
+                    localFLMap[h.fragLen]++;
                 }
-
             }
 
         }
 
-        validHits += (mappedFrag) ? 1 : 0;
-        totalHits += jointHits.size();
-        locRead++;
-        ++numObservedFragments;
-        if (numObservedFragments % 500000 == 0) {
-    	    iomutex.lock();
-            fmt::print(stderr, "\033[A\r\rprocessed {} fragments\n", numObservedFragments);
-            fmt::print(stderr, "hits: {}, hits per frag (may not be concordant):  {}",
-                    totalHits,
-                    totalHits / static_cast<float>(prevObservedFrags));
-            iomutex.unlock();
+        counters.numMappedFragments += (mappedFrag) ? 1 : 0;
+        counters.numFragHits += jointHits.size();
+        ++counters.numObservedFragments;
+
+        if (readCache) {
+            mapping.hadHits = upperBound;
+            mapping.numHits = jointHits.size();
+            readCache->insert(cacheKey, mapping);
         }
 
-    } // end for i < j->nb_filled
-    prevObservedFrags = numObservedFragments;
+    } // end for r < j->nb_filled
+    counters.flush(readExp);
+  }
+
+  // Add the observations of this thread to the shared ones
+  biasBudget.release();
+  flBudget.release();
+  readExp.readBias().addObserved(readBias);
+  auto& sharedGC = readExp.observedGC();
+  for (size_t i = 0; i < observedGC.size(); ++i) {
+      if (observedGC[i] > 0) { sharedGC[i] += observedGC[i]; }
+  }
+  for (size_t i = 0; i < localFLMap.size(); ++i) {
+      if (localFLMap[i] > 0) { flMap[i] += localFLMap[i]; }
   }
 }
 
@@ -455,20 +718,21 @@ void processReadsQuasi(paired_parser* parser,
  * For single-end reads:
  * Map the reads and accumulate equivalence class counts.
  **/
-template <typename IndexT>
+template <typename IndexT, typename HitOptionsT>
 void processReadsQuasi(single_parser* parser,
         IndexT* sidx,
         ReadExperiment& readExp,
         ReadLibrary& rl,
         SailfishOpts& sfOpts,
+        ReadMappingCache* readCache,
         std::mutex& iomutex) {
 
-    uint64_t prevObservedFrags{1};
-
-    size_t locRead{0};
     uint64_t localUpperBoundHits{0};
     //S_AYUSH_CODE
-    auto& readBias = readExp.readBias();
+    // Bias observations are collected locally and added to the shared
+    // distribution when this thread is done.
+    ReadKmerDist<6, uint32_t> readBias;
+    SampleBudget biasBudget(sfOpts.numBiasSamples, 256);
     const char* txomeStr = sidx->seq.c_str();
     //T_AYUSH_CODE
 
@@ -476,61 +740,106 @@ void processReadsQuasi(single_parser* parser,
     size_t readLen{0};
     size_t maxNumHits{sfOpts.maxReadOccs};
 
-    auto& numObservedFragments = readExp.numObservedFragmentsAtomic();
-    auto& validHits = readExp.numMappedFragmentsAtomic();
-    auto& totalHits = readExp.numFragHitsAtomic();
-    auto& upperBoundHits = readExp.upperBoundHitsAtomic();
-    auto& eqBuilder = readExp.equivalenceClassBuilder();
+    // Counts for this thread; added to the totals after every batch
+    MappingCounters counters;
+    // The result of mapping the current read, as stored in the read cache
+    ReadMappingResult mapping;
+    ReadMappingCache::Key cacheKey;
+    ReadMappingCache::Key nextCacheKey;
+    std::unique_ptr<ReadBucketer> bucketer{nullptr};
+    if (sfOpts.bucketWindow > 0) { bucketer.reset(new ReadBucketer()); }
+    // Equivalence class counts are gathered locally and merged in batches
+    EquivalenceClassAccumulator eqBuilder(readExp.equivalenceClassBuilder());
     auto& transcripts = readExp.transcripts();
 
     //auto sidx = readExp.getIndex();
     SACollector<IndexT> hitCollector(sidx);
     SASearcher<IndexT> saSearcher(sidx);
+    // Loads the index entries of the next reads' first k-mers ahead of
+    // their search
+    AnchorPrefetcher<IndexT> anchorPrefetcher(sidx);
+    bool prefetchAnchors = sfOpts.prefetchAnchors;
     rapmap::utils::HitCounters hctr;
     std::vector<QuasiAlignment> jointHits;
+    ReadPrefilter prefilter(readExp.getIndex()->kmerFilter(), sfOpts.maxDustScore);
+    // Reusable buffer for the read sequence (see the paired-end version)
+    std::string readSeq;
 
     // *Completely* ignore strandedness information
-    bool ignoreCompat = sfOpts.ignoreLibCompat;
+    constexpr bool ignoreCompat = HitOptionsT::ignoreCompat;
     // Don't *strictly* enforce compatibility --- if
     // the only hits are incompatible with the library
     // type then allow them.
-    bool enforceCompat = sfOpts.enforceLibCompat;
+    constexpr bool enforceCompat = HitOptionsT::enforceCompat;
     // True when we have compatible hits, false otherwise
     bool haveCompat{false};
-    auto expectedLibType = rl.format();
+    sailfish::utils::LibraryCompatibility libCompat(rl.format());
 
     bool mappedFrag{false};
 
     std::vector<uint32_t> txpIDsAll;
-    std::vector<double> auxProbsAll;
 
     std::vector<uint32_t> txpIDsCompat;
-    std::vector<double> auxProbsCompat;
 
     while(true) {
         typename single_parser::job j(*parser); // Get a job from the parser: a bunch of read (at most max_read_group)
         if(j.is_empty()) break;           // If got nothing, quit
+        parser->batch_consumed();
+
+        const std::vector<uint32_t>* order = bucketer ? &bucketer->order(*j) : nullptr;
+        for(size_t r = 0; r < j->nb_filled; ++r) { // For all the read in this batch
+            size_t i = order ? (*order)[r] : r;
+            auto& rec = j->data[i];
+            readSeq.assign(j->bytes(rec.seq_off), rec.seq_len);
+            readLen = rec.seq_len;
+
+            // If this exact read was mapped before, reuse the result
+            if (readCache) {
+                cacheKey = (r == 0) ? ReadMappingCache::keyFor(readSeq) : nextCacheKey;
+                if (r + 1 < j->nb_filled) {
+                    auto& next = j->data[order ? (*order)[r + 1] : r + 1];
+                    nextCacheKey = ReadMappingCache::keyFor(j->bytes(next.seq_off), next.seq_len);
+                    readCache->prefetch(nextCacheKey);
+                }
+                ++counters.numCacheLookups;
+                if (readCache->lookup(cacheKey, mapping)) {
+                    ++counters.numCacheHits;
+                    applyCachedMapping(mapping, txpIDsCompat, eqBuilder, counters,
+                                       nullptr, nullptr);
+                    continue;
+                }
+                mapping.clear();
+            }
 
-        for(size_t i = 0; i < j->nb_filled; ++i) { // For all the read in this batch
-            readLen = j->data[i].seq.length();
             tooManyHits = false;
             localUpperBoundHits = 0;
             jointHits.clear();
             txpIDsAll.clear();
-            auxProbsAll.clear();
             txpIDsCompat.clear();
-            auxProbsCompat.clear();
             haveCompat = false;
             mappedFrag = false;
 
-            bool lh = hitCollector(j->data[i].seq,
-                    jointHits, saSearcher,
-                    MateStatus::SINGLE_END);
+            if (prefilter(readSeq, counters)) {
+                // See the paired-end version
+                if (prefetchAnchors and r + 2 < j->nb_filled) {
+                    auto& ahead = j->data[order ? (*order)[r + 2] : r + 2];
+                    anchorPrefetcher.prefetchBucket(j->bytes(ahead.seq_off), ahead.seq_len);
+                }
+                if (prefetchAnchors and r + 1 < j->nb_filled) {
+                    auto& next = j->data[order ? (*order)[r + 1] : r + 1];
+                    anchorPrefetcher.prefetchInterval(j->bytes(next.seq_off), next.seq_len);
+                }
+                hitCollector(readSeq, jointHits, saSearcher, MateStatus::SINGLE_END);
+            }
 
-            upperBoundHits += (jointHits.size() > 0);
+            bool upperBound = (jointHits.size() > 0);
+            counters.upperBoundHits += upperBound;
 
             // If the read mapped to > maxReadOccs places, discard it
-            if (jointHits.size() > sfOpts.maxReadOccs ) { jointHits.clear(); }
+            if (jointHits.size() > maxNumHits) {
+                ++counters.numTooManyHits;
+                jointHits.clear();
+            }
 
             if (jointHits.size() > 0) {
 
@@ -539,10 +848,8 @@ void processReadsQuasi(single_parser* parser,
                 int32_t rcAll = 0;
                 int32_t rcCompat = 0;
 
-                double auxSumAll = 0.0;
-                double auxSumCompat = 0.0;
 
-                bool needBiasSample = sfOpts.biasCorrect;
+                bool needBiasSample = HitOptionsT::collectBias and sfOpts.biasCorrect;
 
                 for (auto& h : jointHits) {
                     auto transcriptID = h.transcriptID();
@@ -556,7 +863,7 @@ void processReadsQuasi(single_parser* parser,
                     // If bias correction is turned on, and we haven't sampled a mapping
                     // for this read yet, and we haven't collected the required number of
                     // samples overall.
-                    if(needBiasSample and sfOpts.numBiasSamples > 0){
+                    if(needBiasSample and biasBudget.available()){
                         // the "start" position is the leftmost position if
                         // we hit the forward strand, and the leftmost
                         // position + the read length if we hit the reverse complement
@@ -569,12 +876,9 @@ void processReadsQuasi(single_parser* parser,
                             const char* txpEnd = txpStart + sidx->txpLens[h.tid]; //??
                             */
 
-                            const char* txpStart = txp.Sequence();
-                            const char* readStart = txpStart + startPos; // is this correct?
-                            const char* txpEnd = txpStart+ txp.RefLength;
-                            bool success = readBias.update(txpStart, readStart, txpEnd, dir);
+                            bool success = readBias.update(txp.Sequence(), startPos, dir);
                             if (success) {
-                                sfOpts.numBiasSamples -= 1;
+                                biasBudget.consume();
                                 needBiasSample = false;
                             }
                         }
@@ -584,22 +888,16 @@ void processReadsQuasi(single_parser* parser,
                     // expected library type; false otherwise.
                     bool compat = ignoreCompat;
                     if (!compat) {
-                        compat = sailfish::utils::compatibleHit(
-                                expectedLibType, pos,
-                                h.fwd, h.mateStatus);
+                        compat = libCompat.compatible(h.mateStatus, h.fwd);
                     }
 
                     if (compat) {
                         haveCompat = true;
                         txpIDsCompat.push_back(transcriptID);
-                        auxProbsCompat.push_back(1.0);
-                        auxSumCompat += 1.0;
                         if (h.fwd) { fwCompat++; } else { rcCompat++; }
                     }
                     if (!haveCompat and !enforceCompat) {
                         txpIDsAll.push_back(transcriptID);
-                        auxProbsAll.push_back(1.0);
-                        auxSumAll += 1.0;
                         if (h.fwd) { fwAll++; } else { rcAll++; }
                     }
         }
@@ -608,41 +906,40 @@ void processReadsQuasi(single_parser* parser,
                 if (haveCompat) {
                     if (txpIDsCompat.size() > 0) {
                         mappedFrag = true;
-                        TranscriptGroup tg(txpIDsCompat);
-                        eqBuilder.addGroup(std::move(tg), auxProbsCompat);
-                        readExp.addNumFwd(fwCompat);
-                        readExp.addNumRC(rcCompat);
+                        eqBuilder.addGroup(txpIDsCompat);
+                        counters.numFwd += fwCompat;
+                        counters.numRC += rcCompat;
+                        if (readCache) { mapping.setClass(txpIDsCompat, fwCompat, rcCompat); }
                     }
                 } else {
                     if (txpIDsAll.size() > 0) {
                         // Otherwise, consider all hits.
                         mappedFrag = true;
-                        TranscriptGroup tg(txpIDsAll);
-                        eqBuilder.addGroup(std::move(tg), auxProbsAll);
-                        readExp.addNumFwd(fwAll);
-                        readExp.addNumRC(rcAll);
+                        eqBuilder.addGroup(txpIDsAll);
+                        counters.numFwd += fwAll;
+                        counters.numRC += rcAll;
+                        if (readCache) { mapping.setClass(txpIDsAll, fwAll, rcAll); }
                     }
                 }
             }
 
-            validHits += (mappedFrag) ? 1 : 0;
-            totalHits += jointHits.size();
-            locRead++;
-            ++numObservedFragments;
-            if (numObservedFragments % 500000 == 0) {
-                iomutex.lock();
-                fmt::print(stderr, "\033[A\r\rprocessed {} fragments\n", numObservedFragments);
-                fmt::print(stderr, "hits: {}, hits per frag (may not be concordant):  {}",
-                        totalHits,
-                        totalHits / static_cast<float>(prevObservedFrags));
-
-                iomutex.unlock();
+            counters.numMappedFragments += (mappedFrag) ? 1 : 0;
+            counters.numFragHits += jointHits.size();
+            ++counters.numObservedFragments;
+
+            if (readCache) {
+                mapping.hadHits = upperBound;
+                mapping.numHits = jointHits.size();
+                readCache->insert(cacheKey, mapping);
             }
 
-        } // end for i < j->nb_filled
+        } // end for r < j->nb_filled
 
-        prevObservedFrags = numObservedFragments;
+        counters.flush(readExp);
     }
+
+    biasBudget.release();
+    readExp.readBias().addObserved(readBias);
 }
 
 std::vector<double> getNormalFragLengthDist(
@@ -848,203 +1145,354 @@ std::vector<std::string> split(const std::string &s, char delim) {
 }
 
 
+/**
+ * The parser for a single read library.  Exactly one of pairedParser
+ * or singleParser is set, depending on the type of the library.
+ */
+struct LibraryParser {
+    ReadLibrary* rl{nullptr};
+    std::vector<char*> readFiles;
+    std::unique_ptr<paired_parser> pairedParser{nullptr};
+    std::unique_ptr<single_parser> singleParser{nullptr};
+    // Mappings of the reads already seen (if --readCacheSize is set).  The
+    // cache is per library, since compatibility depends on the library type.
+    std::unique_ptr<ReadMappingCache> readCache{nullptr};
+};
+
+/**
+ * Map all of the remaining reads of the library parsed by lp using the
+ * calling thread, with the version of the mapping loop for HitOptionsT.
+ */
+template <typename IndexT, typename HitOptionsT>
+void processLibraryQuasi(LibraryParser& lp,
+                         IndexT* sidx,
+                         ReadExperiment& readExp,
+                         SailfishOpts& sfOpts,
+                         FragLengthCountMap& flMap,
+                         std::atomic<int32_t>& remainingFLOps,
+                         std::mutex& iomutex) {
+    if (lp.pairedParser) {
+        processReadsQuasi<IndexT, HitOptionsT>(lp.pairedParser.get(), sidx, readExp, *lp.rl,
+                                  sfOpts, flMap, remainingFLOps, lp.readCache.get(), iomutex);
+    } else {
+        processReadsQuasi<IndexT, HitOptionsT>(lp.singleParser.get(), sidx, readExp, *lp.rl,
+                                  sfOpts, lp.readCache.get(), iomutex);
+    }
+}
+
+/**
+ * Map all of the remaining reads of the library parsed by lp
+ * using the calling thread.
+ */
+template <typename IndexT>
+void processLibraryQuasi(LibraryParser& lp,
+                         IndexT* sidx,
+                         ReadExperiment& readExp,
+                         SailfishOpts& sfOpts,
+                         FragLengthCountMap& flMap,
+                         std::atomic<int32_t>& remainingFLOps,
+                         std::mutex& iomutex) {
+    // Pick the version of the mapping loop that is specialized on these
+    // options (if compatibility is ignored, enforcing it doesn't matter)
+    bool collectBias = sfOpts.biasCorrect or sfOpts.gcBiasCorrect;
+    if (sfOpts.ignoreLibCompat) {
+        if (collectBias) {
+            processLibraryQuasi<IndexT, HitOptions<true, false, true>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        } else {
+            processLibraryQuasi<IndexT, HitOptions<true, false, false>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        }
+    } else if (sfOpts.enforceLibCompat) {
+        if (collectBias) {
+            processLibraryQuasi<IndexT, HitOptions<false, true, true>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        } else {
+            processLibraryQuasi<IndexT, HitOptions<false, true, false>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        }
+    } else {
+        if (collectBias) {
+            processLibraryQuasi<IndexT, HitOptions<false, false, true>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        } else {
+            processLibraryQuasi<IndexT, HitOptions<false, false, false>>(
+                    lp, sidx, readExp, sfOpts, flMap, remainingFLOps, iomutex);
+        }
+    }
+}
+
+/**
+ * The number of files (or file pairs) of a library with numInputs of them
+ * that are parsed concurrently.  A producer slot is taken by whichever
+ * thread finds the parsed read queue empty, so when the input is split
+ * over many files, more slots let parsing keep up with the mapping threads.
+ */
+uint32_t numConcurrentProducers(const SailfishOpts& sfOpts, size_t numInputs) {
+    uint32_t maxProducers = (sfOpts.numParsingThreads > 0) ?
+                            sfOpts.numParsingThreads :
+                            std::max(1u, sfOpts.numThreads / 4);
+    return std::max(1u, std::min(static_cast<uint32_t>(numInputs), maxProducers));
+}
+
+/**
+ * The number of read batches that the parser of a library keeps around.
+ * Every mapping thread holds one batch while every producer fills one, so
+ * the read-ahead is never smaller than that.
+ */
+uint32_t numReadAheadBatches(const SailfishOpts& sfOpts, uint32_t numProducers) {
+    uint32_t minBatches = sfOpts.numThreads + numProducers;
+    uint32_t numBatches = (sfOpts.numReadAheadBatches > 0) ?
+                          sfOpts.numReadAheadBatches :
+                          4 * sfOpts.numThreads + 2 * numProducers;
+    return std::max(minBatches, numBatches);
+}
+
 void quasiMapReads(
         ReadExperiment& readExp,
         SailfishOpts& sfOpts,
         std::mutex& iomutex){
 
     std::vector<std::thread> threads;
-    auto& rl = readExp.readLibraries().front();
-    rl.checkValid();
-
+    auto& readLibraries = readExp.readLibraries();
     auto numThreads = sfOpts.numThreads;
 
-    std::unique_ptr<paired_parser> pairedParserPtr{nullptr};
-    std::unique_ptr<single_parser> singleParserPtr{nullptr};
-
     // Remember the fragment lengths that we see in each thread
     //std::vector<FragLengthCountMap> flMaps(numThreads);
     FragLengthCountMap flMap(sfOpts.maxFragLen, 0);
+    std::atomic<int32_t> remainingFLOps{sfOpts.numFragSamples};
+
+    size_t maxReadGroup{readGroupSize}; // Number of reads in each "job"
+    // When the reads are bucketed by minimizer, each job is one window
+    if (sfOpts.bucketWindow > 0) {
+        maxReadGroup = sfOpts.bucketWindow;
+        sfOpts.jointLog->info("Mapping the reads of each window of {} in order of "
+                              "their minimizers", maxReadGroup);
+    }
+    bool havePairedLibrary{false};
+
+    // Validate every library and create its parser up front, so that
+    // we fail before any reads are mapped if one of them is bad.
+    std::vector<LibraryParser> libParsers(readLibraries.size());
+    for (size_t libID = 0; libID < readLibraries.size(); ++libID) {
+        auto& rl = readLibraries[libID];
+        auto& lp = libParsers[libID];
+        rl.checkValid();
+        lp.rl = &rl;
+
+        // ------ Paired-end --------
+        if (rl.format().type == ReadType::PAIRED_END) {
+            if (rl.mates1().size() != rl.mates2().size()) {
+                sfOpts.jointLog->error("The number of provided files for "
+                        "-1 and -2 must be the same (library {})!", rl.readFilesAsString());
+                sfOpts.jointLog->flush();
+                spdlog::drop_all();
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                std::exit(1);
+            }
 
-    // If the read library is paired-end
-    // ------ Paired-end --------
-    if (rl.format().type == ReadType::PAIRED_END) {
+            havePairedLibrary = true;
+            bool interleaved = rl.isInterleaved();
+            // Each producer reads one interleaved file, or one pair of mate files
+            size_t numInputs{0};
+            if (interleaved) {
+                numInputs = rl.interleaved().size();
+                for (auto& fn : rl.interleaved()) {
+                    lp.readFiles.push_back(const_cast<char*>(fn.c_str()));
+                }
+            } else {
+                numInputs = rl.mates1().size();
+                for (size_t i = 0; i < rl.mates1().size(); ++i) {
+                    lp.readFiles.push_back(const_cast<char*>(rl.mates1()[i].c_str()));
+                    lp.readFiles.push_back(const_cast<char*>(rl.mates2()[i].c_str()));
+                }
+            }
+            size_t numFiles = lp.readFiles.size();
+
+            // Number of file pairs to read simultaneously
+            uint32_t concurrentFile = numConcurrentProducers(sfOpts, numInputs);
+            // The decompression threads are shared by all of the open files
+            uint32_t decompThreads = std::max(1u, sfOpts.numDecompressionThreads /
+                                                  static_cast<uint32_t>(concurrentFile * (numFiles / numInputs)));
+            lp.pairedParser.reset(new
+                    paired_parser(numReadAheadBatches(sfOpts, concurrentFile), maxReadGroup,
+                        concurrentFile,
+                        lp.readFiles.data(), lp.readFiles.data() + numFiles,
+                        decompThreads,
+                        false, false, // don't keep read headers or quality values
+                        interleaved));
+        } // ------ Single-end --------
+        else if (rl.format().type == ReadType::SINGLE_END) {
+            size_t numFiles = rl.unmated().size();
+            lp.readFiles.resize(numFiles);
+            for (size_t i = 0; i < numFiles; ++i) {
+                lp.readFiles[i] = const_cast<char*>(rl.unmated()[i].c_str());
+            }
 
-        if (rl.mates1().size() != rl.mates2().size()) {
-            sfOpts.jointLog->error("The number of provided files for "
-                    "-1 and -2 must be the same!");
-            sfOpts.jointLog->flush();
-            spdlog::drop_all();
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            std::exit(1);
+            // Number of files to read simultaneously
+            uint32_t concurrentFile = numConcurrentProducers(sfOpts, numFiles);
+            // The decompression threads are shared by all of the open files
+            uint32_t decompThreads = std::max(1u, sfOpts.numDecompressionThreads / concurrentFile);
+            lp.singleParser.reset(new single_parser(numReadAheadBatches(sfOpts, concurrentFile),
+                        maxReadGroup,
+                        concurrentFile,
+                        lp.readFiles.data(), lp.readFiles.data() + numFiles,
+                        decompThreads));
         }
+    }
 
-        size_t numFiles = rl.mates1().size() + rl.mates2().size();
-        char** pairFileList = new char*[numFiles];
-        //std::vector<std::ifstream*> pairFileList(numFiles);
-        //pairFileList.reserve(numFiles);
-        for (size_t i = 0; i < rl.mates1().size(); ++i) {
-            pairFileList[2*i] = const_cast<char*>(rl.mates1()[i].c_str());
-            pairFileList[2*i+1] = const_cast<char*>(rl.mates2()[i].c_str());
-            //pairFileList[2*i] = new std::ifstream(rl.mates1()[i]);
-            //pairFileList[2*i+1] = new std::ifstream(rl.mates2()[i]);
-        }
+    size_t numLibs = libParsers.size();
+    if (numLibs > 1) {
+        sfOpts.jointLog->info("Mapping reads from {} libraries concurrently", numLibs);
+    }
 
-        size_t maxReadGroup{readGroupSize}; // Number of reads in each "job"
-        size_t concurrentFile{2}; // Number of files to read simultaneously
-        pairedParserPtr.reset(new
-                paired_parser(4 * numThreads, maxReadGroup,
-                    concurrentFile,
-                    pairFileList, pairFileList+numFiles));
-                    //pairFileList.begin(), pairFileList.end()));
-
-        std::atomic<int32_t> remainingFLOps{sfOpts.numFragSamples};
-
-        for(int i = 0; i < numThreads; ++i)  {
-            // NOTE: we *must* capture i by value here, b/c it can (sometimes, does)
-            // change value before the lambda below is evaluated --- crazy!
-
-            // if we have a 64-bit index
-            if (readExp.getIndex()->is64BitQuasi()) {
-                auto threadFun = [&,i]() -> void {
-                    processReadsQuasi<RapMapSAIndex<int64_t>>(
-                            pairedParserPtr.get(),
-                            readExp.getIndex()->quasiIndex64(),
-                            readExp,
-                            rl,
-                            sfOpts,
-                            flMap,
-                            remainingFLOps,
-                            iomutex);
-                };
-                threads.emplace_back(threadFun);
-            } else {
-                auto threadFun = [&,i]() -> void {
-                    processReadsQuasi<RapMapSAIndex<int32_t>>(
-                            pairedParserPtr.get(),
-                            readExp.getIndex()->quasiIndex32(),
-                            readExp,
-                            rl,
-                            sfOpts,
-                            flMap,
-                            remainingFLOps,
-                            iomutex);
-                };
-            threads.emplace_back(threadFun);
+    // Progress (and, optionally, the metrics file) is reported from
+    // a separate thread, so the mapping threads only update counters.
+    MappingMetricsReporter metrics(readExp, sfOpts, iomutex);
+    for (auto& lp : libParsers) {
+        LibraryParser* lpp = &lp;
+        metrics.addQueue(lp.rl->readFilesAsString(), [lpp]() -> int64_t {
+            if (lpp->pairedParser) {
+                return lpp->pairedParser->batches_produced() - lpp->pairedParser->batches_consumed();
+            }
+            return lpp->singleParser->batches_produced() - lpp->singleParser->batches_consumed();
+        });
+    }
+    metrics.start();
+    auto mappingStart = std::chrono::steady_clock::now();
+
+    // Exact duplicate reads (or read pairs) can skip mapping altogether by
+    // reusing the result from the first copy.  The cached result doesn't
+    // include the bias samples of the read, so the cache is only used when
+    // bias correction is off.
+    if (sfOpts.readCacheSize > 0) {
+        if (sfOpts.biasCorrect or sfOpts.gcBiasCorrect) {
+            sfOpts.jointLog->warn("The duplicate read cache (--readCacheSize) can't be "
+                                  "used with bias correction; it has been disabled");
+            sfOpts.readCacheSize = 0;
+        } else {
+            for (auto& lp : libParsers) {
+                lp.readCache.reset(new ReadMappingCache(sfOpts.readCacheSize));
             }
         }
+    }
 
-        // Join the threads and collect the results from the count maps
-        size_t totalObs{0};
-        std::map<uint32_t, uint32_t> jointMap;
+    // Each worker starts on library (i mod numLibs), so that all libraries
+    // are being read from at once, and then moves on to help with the
+    // other libraries once its own is exhausted.  All of them feed the
+    // same equivalence class builder.
+    for(int i = 0; i < numThreads; ++i)  {
+        // NOTE: we *must* capture i by value here, b/c it can (sometimes, does)
+        // change value before the lambda below is evaluated --- crazy!
+        auto threadFun = [&,i]() -> void {
+            for (size_t k = 0; k < numLibs; ++k) {
+                auto& lp = libParsers[(i + k) % numLibs];
+                // if we have a 64-bit index
+                if (readExp.getIndex()->is64BitQuasi()) {
+                    processLibraryQuasi<RapMapSAIndex<int64_t>>(
+                            lp, readExp.getIndex()->quasiIndex64(), readExp,
+                            sfOpts, flMap, remainingFLOps, iomutex);
+                } else {
+                    processLibraryQuasi<RapMapSAIndex<int32_t>>(
+                            lp, readExp.getIndex()->quasiIndex32(), readExp,
+                            sfOpts, flMap, remainingFLOps, iomutex);
+                }
+            }
+        };
+        threads.emplace_back(threadFun);
+    }
 
-	// join all the worker threads
-        for(int i = 0; i < numThreads; ++i) { threads[i].join(); }
+    // join all the worker threads
+    for(int i = 0; i < numThreads; ++i) { threads[i].join(); }
+    metrics.stop();
+    std::chrono::duration<double> mappingTime = std::chrono::steady_clock::now() - mappingStart;
 
-        for (size_t i = 0; i < flMap.size(); ++i) {
-            jointMap[i] = flMap[i];
-            totalObs += flMap[i];
-        }
+    // we need an extra newline here.
+    fmt::print(stderr, "\n");
 
-	// we need an extra newline here.
-	fmt::print(stderr, "\n");
+    sfOpts.jointLog->info("Mapped {} fragments in {:.2f} s ({:.0f} fragments/s)",
+                          readExp.numObservedFragments(), mappingTime.count(),
+                          (mappingTime.count() > 0) ?
+                          readExp.numObservedFragments() / mappingTime.count() : 0.0);
 
-        sfOpts.jointLog->info("Gathered fragment lengths from all threads");
+    if (readExp.numMateSearchesSkipped() > 0) {
+        sfOpts.jointLog->info("Skipped the search for {} mates whose "
+                              "partner had no hits", readExp.numMateSearchesSkipped());
+    }
+    if (readExp.numKmerFiltered() > 0 or readExp.numLowComplexity() > 0) {
+        sfOpts.jointLog->info("Rejected {} reads with no k-mer in the index and {} "
+                              "low-complexity reads without searching the index",
+                              readExp.numKmerFiltered(), readExp.numLowComplexity());
+    }
+    if (readExp.numTooManyHits() > 0) {
+        sfOpts.jointLog->info("Discarded {} fragments that mapped to more than {} "
+                              "places (--maxReadOcc)",
+                              readExp.numTooManyHits(), sfOpts.maxReadOccs);
+    }
 
-        /** If we have a sufficient number of observations for the empirical
-         *  distribution, then use that --- otherwise use the provided prior
-         *  mean fragment length.
-         **/
-        // Note: if "noEffectiveLengthCorrection" is set, so that these values
-        // won't matter anyway, then don't bother computing this "expensive"
-        // version.
-        if (sfOpts.noEffectiveLengthCorrection) {
-            setEffectiveLengthsDirect(readExp, sfOpts);
-        } else {
-            // We didn't have sufficient observations, use the provided
-            // values
-            if (remainingFLOps > 0) {
-                sfOpts.jointLog->warn("Sailfish saw fewer then {} uniquely mapped reads "
-                        "so {} will be used as the mean fragment length and {} as "
-                        "the standard deviation for effective length correction",
-                        sfOpts.numFragSamples,
-                        sfOpts.fragLenDistPriorMean,
-                        sfOpts.fragLenDistPriorSD);
-                // Set the fragment length distribution in the ReadExperiment
-                readExp.setFragLengthDist(getNormalFragLengthCounts(sfOpts));
-                auto correctionFactors = getNormalFragLengthDist(sfOpts);
-                computeSmoothedEffectiveLengths(sfOpts, readExp.transcripts(), correctionFactors);
-            } else {
-                // Set the fragment length distribution in the ReadExperiment
-                std::vector<int32_t> fld(flMap.size(), 0);
-                for (size_t i = 0; i < flMap.size(); ++i) {
-                    fld[i] = static_cast<int32_t>(flMap[i]);
-                }
-                readExp.setFragLengthDist(fld);
+    if (sfOpts.readCacheSize > 0) {
+        uint64_t lookups = readExp.numReadCacheLookups();
+        uint64_t hits = readExp.numReadCacheHits();
+        sfOpts.jointLog->info("The duplicate read cache answered {} of {} lookups ({:.2f}%)",
+                              hits, lookups,
+                              (lookups > 0) ? (100.0 * hits) / lookups : 0.0);
+    }
 
-                if (sfOpts.useUnsmoothedFLD) {
-                    computeEmpiricalEffectiveLengths(sfOpts, readExp.transcripts(), jointMap);
-                } else {
-                    auto correctionFactors = correctionFactorsFromCounts(sfOpts, jointMap);
-                    computeSmoothedEffectiveLengths(sfOpts, readExp.transcripts(), correctionFactors);
-                }
-            }
+    /** If we have a sufficient number of observations for the empirical
+     *  distribution, then use that --- otherwise use the provided prior
+     *  mean fragment length.  Only paired-end libraries contribute
+     *  observations.
+     **/
+    // Note: if "noEffectiveLengthCorrection" is set, so that these values
+    // won't matter anyway, then don't bother computing this "expensive"
+    // version.
+    if (sfOpts.noEffectiveLengthCorrection) {
+        setEffectiveLengthsDirect(readExp, sfOpts);
+    } else if (havePairedLibrary and remainingFLOps <= 0) {
+        sfOpts.jointLog->info("Gathered fragment lengths from all threads");
+
+        // Collect the results from the count maps
+        std::map<uint32_t, uint32_t> jointMap;
+        for (size_t i = 0; i < flMap.size(); ++i) {
+            jointMap[i] = flMap[i];
         }
-    } // ------ Single-end --------
-    else if (rl.format().type == ReadType::SINGLE_END) {
-
-        char* readFiles[] = { const_cast<char*>(rl.unmated().front().c_str()) };
-        size_t maxReadGroup{readGroupSize}; // Number of files to read simultaneously
-        size_t concurrentFile{1}; // Number of reads in each "job"
-        stream_manager streams( rl.unmated().begin(),
-                rl.unmated().end(), concurrentFile);
-
-        singleParserPtr.reset(new single_parser(4 * numThreads,
-                    maxReadGroup,
-                    concurrentFile,
-                    streams));
-
-        for(int i = 0; i < numThreads; ++i)  {
-            // NOTE: we *must* capture i by value here, b/c it can (sometimes, does)
-            // change value before the lambda below is evaluated --- crazy!
-            if (readExp.getIndex()->is64BitQuasi()) {
-                auto threadFun = [&,i]() -> void {
-                    processReadsQuasi<RapMapSAIndex<int64_t>>(
-                            singleParserPtr.get(),
-                            readExp.getIndex()->quasiIndex64(),
-                            readExp,
-                            rl,
-                            sfOpts,
-                            iomutex);
-                };
-                threads.emplace_back(threadFun);
-            } else {
-                auto threadFun = [&,i]() -> void {
-                    processReadsQuasi<RapMapSAIndex<int32_t>>(
-                            singleParserPtr.get(),
-                            readExp.getIndex()->quasiIndex32(),
-                            readExp,
-                            rl,
-                            sfOpts,
-                            iomutex);
-                };
-                threads.emplace_back(threadFun);
-            }
+
+        // Set the fragment length distribution in the ReadExperiment
+        std::vector<int32_t> fld(flMap.size(), 0);
+        for (size_t i = 0; i < flMap.size(); ++i) {
+            fld[i] = static_cast<int32_t>(flMap[i]);
         }
-        for(int i = 0; i < numThreads; ++i) { threads[i].join(); }
-        if (sfOpts.noEffectiveLengthCorrection) {
-            setEffectiveLengthsDirect(readExp, sfOpts);
-        } else {
-            // Set the fragment length distribution in the ReadExperiment
-            readExp.setFragLengthDist(getNormalFragLengthCounts(sfOpts));
+        readExp.setFragLengthDist(fld);
 
-            auto correctionFactors = getNormalFragLengthDist(sfOpts);
+        if (sfOpts.useUnsmoothedFLD) {
+            computeEmpiricalEffectiveLengths(sfOpts, readExp.transcripts(), jointMap);
+        } else {
+            auto correctionFactors = correctionFactorsFromCounts(sfOpts, jointMap);
             computeSmoothedEffectiveLengths(sfOpts, readExp.transcripts(), correctionFactors);
         }
-    } // ------ END Single-end --------
+    } else {
+        // We didn't have sufficient observations (or had no paired-end
+        // reads at all), use the provided values
+        if (havePairedLibrary) {
+            sfOpts.jointLog->warn("Sailfish saw fewer then {} uniquely mapped reads "
+                    "so {} will be used as the mean fragment length and {} as "
+                    "the standard deviation for effective length correction",
+                    sfOpts.numFragSamples,
+                    sfOpts.fragLenDistPriorMean,
+                    sfOpts.fragLenDistPriorSD);
+        }
+        // Set the fragment length distribution in the ReadExperiment
+        readExp.setFragLengthDist(getNormalFragLengthCounts(sfOpts));
+        auto correctionFactors = getNormalFragLengthDist(sfOpts);
+        computeSmoothedEffectiveLengths(sfOpts, readExp.transcripts(), correctionFactors);
+    }
 }
 
-int mainQuantify(int argc, char* argv[]) {
+/**
+ * Runs `sailfish quant`.  If residentIndex is given, the job was sent to
+ * `sailfish serve`, and the index it has already loaded is used.
+ */
+int quantify(int argc, char* argv[], std::shared_ptr<SailfishIndex> residentIndex) {
     using std::cerr;
     using std::vector;
     using std::string;
@@ -1060,6 +1508,7 @@ int mainQuantify(int argc, char* argv[]) {
     vector<string> unmatedReadFiles;
     vector<string> mate1ReadFiles;
     vector<string> mate2ReadFiles;
+    vector<string> interleavedReadFiles;
     string txpAggregationKey;
 
     bool discardOrphans = false;
@@ -1071,13 +1520,21 @@ int mainQuantify(int argc, char* argv[]) {
         ("index,i", po::value<string>()->required(), "Sailfish index")
         ("libType,l", po::value<std::string>()->required(), "Format string describing the library type")
         ("unmatedReads,r", po::value<vector<string>>(&unmatedReadFiles)->multitoken(),
-         "List of files containing unmated reads of (e.g. single-end reads)")
+         "List of files containing unmated reads of (e.g. single-end reads); - reads from the standard input")
         ("mates1,1", po::value<vector<string>>(&mate1ReadFiles)->multitoken(),
          "File containing the #1 mates")
         ("mates2,2", po::value<vector<string>>(&mate2ReadFiles)->multitoken(),
          "File containing the #2 mates")
+        ("interleaved", po::value<vector<string>>(&interleavedReadFiles)->multitoken(),
+         "File(s) containing paired-end reads where the #1 and #2 mate of each pair are consecutive records.  "
+         "Use - to read them from the standard input (e.g. when piping from a read trimmer).")
         ("threads,p", po::value<uint32_t>(&(sopt.numThreads))->default_value(sopt.numThreads), "The number of threads to use concurrently.")
         ("output,o", po::value<std::string>()->required(), "Output quantification file.")
+        ("server", po::value<std::string>(), "The socket of a `sailfish serve` process that has the index "
+         "(-i) loaded.  If given, the job is run by that server, which saves loading the index; the output "
+         "is written to the same place as for a local run.  The server opens the read files itself, so they "
+         "must be readable by it.  The standard input (- or /dev/stdin) and the /dev/fd/N paths created by "
+         "process substitution (e.g. <(zcat reads.fq.gz)) are passed to the server, up to 16 of the latter.")
         ("geneMap,g", po::value<string>(), "File containing a mapping of transcripts to genes.  If this file is provided "
          "Sailfish will output both quant.sf and quant.genes.sf files, where the latter "
          "contains aggregated gene-level abundance estimates.  The transcript to gene mapping "
@@ -1111,6 +1568,39 @@ int mainQuantify(int argc, char* argv[]) {
             "characteristic function over each transcript")
         ("maxFragLen", po::value<uint32_t>(&(sopt.maxFragLen))->default_value(1000), "The maximum length of a fragment to consider when "
             "building the empirical fragment length distribution")
+        ("decompressionThreads", po::value<uint32_t>(&(sopt.numDecompressionThreads))->default_value(0), "The number of threads used "
+            "to decompress the gzipped read files of a library; they are divided among the files that are open at the same time.  "
+            "BGZF-compressed files are decompressed in parallel; regular gzip files always "
+            "use a single (dedicated) decompression thread.  If 0, this is set based on the number of mapping threads.")
+        ("parsingThreads", po::value<uint32_t>(&(sopt.numParsingThreads))->default_value(0), "The maximum number of read files "
+            "(or pairs of files, for paired-end libraries) of a library that are parsed at the same time.  Parsing is done "
+            "by whichever threads find no parsed reads waiting, so this bounds how many of them can parse at once.  "
+            "If 0, this is set based on the number of mapping threads.")
+        ("readAheadBatches", po::value<uint32_t>(&(sopt.numReadAheadBatches))->default_value(0), "The number of batches of "
+            "parsed reads buffered ahead of the mapping threads for each library.  If 0, this is set based on the number "
+            "of threads.")
+        ("metricsFile", po::value<std::string>(&(sopt.metricsFile)), "If provided, a JSON summary of the mapping "
+            "progress (fragments processed, fragments per second, mapping rate, hits per fragment and the number of parsed "
+            "read batches waiting for each library) is written to this file every --metricsInterval seconds while mapping.")
+        ("metricsInterval", po::value<uint32_t>(&(sopt.metricsInterval))->default_value(5), "The number of seconds "
+            "between updates of the --metricsFile.")
+        ("readCacheSize", po::value<uint32_t>(&(sopt.readCacheSize))->default_value(0), "If non-zero, the mapping of "
+            "each read (or read pair) is remembered in a cache with (about) this many entries, and exact duplicates "
+            "of a cached read reuse its mapping rather than being mapped again.  Useful for libraries with a high "
+            "duplication rate.  Not compatible with --biasCorrect or --gcBiasCorrect.")
+        ("maxDustScore", po::value<double>(&(sopt.maxDustScore))->default_value(0.0), "If non-zero, reads (or "
+            "mates) whose DUST score is above this are treated as unmapped without searching the index.  Random "
+            "sequence scores about 1, while homopolymers and short tandem repeats score 20 or more.  Reads with no "
+            "k-mer in the index are always rejected early (if the index has a k-mer filter).")
+        ("bucketWindow", po::value<uint32_t>(&(sopt.bucketWindow))->default_value(0), "If non-zero, the reads are "
+            "parsed in windows of this many reads (or read pairs), and the reads of each window are mapped in order of "
+            "their minimizers, so that reads from the same part of the transcriptome are mapped together and find "
+            "the index in the CPU caches.  Larger windows group more reads, but hold more reads in memory.  If 0, the "
+            "reads are mapped in the order in which they are read.")
+        ("prefetchAnchors", po::bool_switch(&(sopt.prefetchAnchors))->default_value(false),
+            "While a read is searched, prefetch the index's hash bucket for the first k-mer of the read after next, "
+            "and the ends and middle of the suffix array interval of the next read's first k-mer.  Compare the "
+            "mapping throughput logged at the end of mapping with and without this option.")
       	//("readEqClasses", po::value<std::string>(&eqClassFile), "Read equivalence classes in directly")
         ("txpAggregationKey", po::value<std::string>(&txpAggregationKey)->default_value("gene_id"), "When generating the gene-level estimates, "
             "use the provided key for aggregating transcripts.  The default is the \"gene_id\" field, but other fields (e.g. \"gene_name\") might "
@@ -1179,10 +1669,21 @@ int mainQuantify(int argc, char* argv[]) {
 
         po::notify(vm);
 
+        // Hand the job to the server, if there is one
+        if (vm.count("server") and !residentIndex) {
+            int status = sailfish::server::submitQuantJob(vm["server"].as<std::string>(), argc, argv);
+            if (status != 0) { std::exit(status); }
+            return 0;
+        }
+
         if (discardOrphans) {
             sopt.allowOrphans = false;
         }
 
+        if (sopt.numDecompressionThreads == 0) {
+            sopt.numDecompressionThreads = std::max(1u, sopt.numThreads / 4);
+        }
+
         std::stringstream commentStream;
         commentStream << "# sailfish (quasi-mapping-based) v" << sailfish::version << "\n";
         commentStream << "# [ program ] => sailfish \n";
@@ -1314,7 +1815,13 @@ int mainQuantify(int argc, char* argv[]) {
         boost::filesystem::path versionPath = indexDirectory / "versionInfo.json";
         versionInfo.load(versionPath);
 
-        ReadExperiment experiment(readLibraries, indexDirectory, sopt);
+        if (residentIndex and !bfs::equivalent(indexDirectory, residentIndex->indexDirectory())) {
+            jointLog->error("This server has the index {} loaded, not {}",
+                            residentIndex->indexDirectory().string(), indexDirectory.string());
+            jointLog->flush();
+            return 1;
+        }
+        ReadExperiment experiment(readLibraries, indexDirectory, sopt, residentIndex);
         // end parameter validation
 
         // This will be the class in charge of maintaining our
@@ -1440,6 +1947,10 @@ int mainQuantify(int argc, char* argv[]) {
     return 0;
 }
 
+int mainQuantify(int argc, char* argv[]) {
+    return quantify(argc, argv, nullptr);
+}
+
 
 /**
 void loadEquivClasses(const std::string& eqClassFile,
@@ -0,0 +1,402 @@
+/**
+>HEADER
+    Copyright (c) 2015 Rob Patro rob.patro@cs.stonybrook.edu
+
+    This file is part of Sailfish.
+
+    Sailfish is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Sailfish is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Sailfish.  If not, see <http://www.gnu.org/licenses/>.
+<HEADER
+**/
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/program_options.hpp>
+#include <boost/filesystem.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "SailfishIndex.hpp"
+#include "SailfishServer.hpp"
+
+// Defined in SailfishQuantify.cpp
+int quantify(int argc, char* argv[], std::shared_ptr<SailfishIndex> residentIndex);
+
+/**
+ * The protocol between `quant --server` and `sailfish serve`: the client
+ * sends the length of the request as a uint64_t, along with its standard
+ * input, output and error and the descriptors named on its command line
+ * (as SCM_RIGHTS ancillary data), and then the request itself --- its
+ * working directory followed by its command line, each NUL-terminated.
+ * The server replies with the exit status of the job, as an int32_t, once
+ * the job is done.
+ */
+namespace sailfish {
+namespace server {
+
+namespace {
+
+// Standard input, output and error are always passed, followed by the
+// descriptors named on the command line (at most maxArgFds of them)
+constexpr size_t numStdFds{3};
+constexpr size_t maxArgFds{16};
+
+/**
+ * If arg (or the value of an --option=value argument) names one of the
+ * process' descriptors, as /dev/fd/N or /proc/self/fd/N (e.g. from
+ * process substitution), set fd to N and return the position at which
+ * the path starts.  Otherwise, return std::string::npos.
+ */
+size_t descriptorPath(const std::string& arg, int& fd) {
+    size_t start = (arg.compare(0, 2, "--") == 0 and arg.find('=') != std::string::npos) ?
+                   arg.find('=') + 1 : 0;
+    for (const std::string prefix : {"/dev/fd/", "/proc/self/fd/"}) {
+        if (arg.compare(start, prefix.size(), prefix) != 0) { continue; }
+        std::string num = arg.substr(start + prefix.size());
+        if (num.empty() or num.size() > 9 or
+            num.find_first_not_of("0123456789") != std::string::npos) {
+            return std::string::npos;
+        }
+        fd = std::stoi(num);
+        return start;
+    }
+    return std::string::npos;
+}
+
+bool writeAll(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 and errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool readAll(int fd, char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 and errno == EINTR) { continue; }
+        if (n <= 0) { return false; }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+sockaddr_un socketAddress(const std::string& socketPath) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("The socket path " + socketPath + " is too long");
+    }
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+/**
+ * Read a request from conn, and run it in a new process (which shares
+ * the pages of the index with the server), with the client's standard
+ * input, output and error and in its working directory.  The descriptor
+ * paths on its command line are rewritten to refer to the descriptors
+ * passed with it.  Returns the exit status to report to the client.
+ */
+int32_t runJob(int conn, std::shared_ptr<SailfishIndex>& index) {
+    uint64_t requestLen{0};
+    int fds[numStdFds + maxArgFds];
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec iov{&requestLen, sizeof(requestLen)};
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(conn, &msg, MSG_WAITALL) != sizeof(requestLen)) { return 1; }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr or cmsg->cmsg_type != SCM_RIGHTS or
+        cmsg->cmsg_len < CMSG_LEN(numStdFds * sizeof(int))) {
+        return 1;
+    }
+    size_t numFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    std::memcpy(fds, CMSG_DATA(cmsg), numFds * sizeof(int));
+    struct FdCloser {
+        int* fds;
+        size_t n;
+        ~FdCloser() { for (size_t i = 0; i < n; ++i) { close(fds[i]); } }
+    } closeFds{fds, numFds};
+
+    std::vector<char> request(requestLen);
+    if (!readAll(conn, request.data(), requestLen) or
+        requestLen == 0 or request.back() != '\0') {
+        return 1;
+    }
+    // The working directory, then the arguments, with the descriptor
+    // paths replaced (in order) by those of the descriptors passed
+    std::vector<std::string> strs;
+    size_t nextFd{numStdFds};
+    for (size_t i = 0; i < requestLen; i += std::strlen(&request[i]) + 1) {
+        std::string arg(&request[i]);
+        int clientFd{-1};
+        // (as the client does, skipping the working directory and argv[0])
+        size_t pathStart = (strs.size() < 2) ? std::string::npos : descriptorPath(arg, clientFd);
+        if (pathStart != std::string::npos) {
+            if (nextFd == numFds) { return 1; }
+            arg = arg.substr(0, pathStart) + "/dev/fd/" + std::to_string(fds[nextFd++]);
+        }
+        strs.push_back(arg);
+    }
+    if (strs.size() < 2 or nextFd != numFds) { return 1; }
+    std::vector<char*> args;
+    for (auto& s : strs) { args.push_back(&s[0]); }
+
+    pid_t job = fork();
+    if (job < 0) { return 1; }
+    if (job == 0) {
+        close(conn);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        dup2(fds[0], STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[2], STDERR_FILENO);
+        if (chdir(args[0]) != 0) {
+            std::cerr << "Couldn't change to the directory " << args[0] << "\n";
+            std::exit(1);
+        }
+        std::exit(quantify(static_cast<int>(args.size() - 1), args.data() + 1, index));
+    }
+
+    int status{0};
+    while (waitpid(job, &status, 0) < 0 and errno == EINTR) {}
+    if (WIFEXITED(status)) { return WEXITSTATUS(status); }
+    return 128 + WTERMSIG(status);
+}
+
+volatile sig_atomic_t stopServer{0};
+
+void handleStopSignal(int) { stopServer = 1; }
+
+} // anonymous namespace
+
+int submitQuantJob(const std::string& socketPath, int argc, char* argv[]) {
+    std::vector<char> request;
+    std::vector<char> cwd(4096);
+    while (getcwd(cwd.data(), cwd.size()) == nullptr) {
+        if (errno != ERANGE) {
+            std::cerr << "Couldn't determine the working directory\n";
+            return 1;
+        }
+        cwd.resize(2 * cwd.size());
+    }
+    request.insert(request.end(), cwd.data(), cwd.data() + std::strlen(cwd.data()) + 1);
+    std::vector<int> fds{STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    for (int i = 0; i < argc; ++i) {
+        request.insert(request.end(), argv[i], argv[i] + std::strlen(argv[i]) + 1);
+        int fd{-1};
+        if (i > 0 and descriptorPath(argv[i], fd) != std::string::npos) {
+            if (fds.size() == numStdFds + maxArgFds) {
+                std::cerr << "At most " << maxArgFds << " descriptor paths (such as "
+                          << argv[i] << ") can be passed to the sailfish server\n";
+                return 1;
+            }
+            fds.push_back(fd);
+        }
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = socketAddress(socketPath);
+    if (sock < 0 or connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Couldn't connect to the sailfish server at " << socketPath
+                  << " [" << std::strerror(errno) << "]\n";
+        if (sock >= 0) { close(sock); }
+        return 1;
+    }
+
+    uint64_t requestLen = request.size();
+    size_t fdBytes = fds.size() * sizeof(int);
+    std::vector<char> control(CMSG_SPACE(fdBytes), 0);
+    iovec iov{&requestLen, sizeof(requestLen)};
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fdBytes);
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), fdBytes);
+
+    int32_t status{1};
+    if (sendmsg(sock, &msg, 0) != sizeof(requestLen) or
+        !writeAll(sock, request.data(), request.size())) {
+        std::cerr << "Couldn't send the job to the sailfish server at " << socketPath << "\n";
+    } else if (!readAll(sock, reinterpret_cast<char*>(&status), sizeof(status))) {
+        std::cerr << "The sailfish server at " << socketPath << " didn't report "
+                  << "the status of the job\n";
+        status = 1;
+    }
+    close(sock);
+    return status;
+}
+
+} // namespace server
+} // namespace sailfish
+
+/**
+ * `sailfish serve` loads an index once and then runs the quant jobs sent
+ * to it (by `sailfish quant --server`) over a Unix domain socket.  Each
+ * job runs in its own process, forked from the server, so it shares the
+ * (read-only) pages of the loaded index and starts mapping immediately,
+ * and a job that fails can't take the server down with it.
+ */
+int mainServe(int argc, char* argv[]) {
+    using std::string;
+    namespace po = boost::program_options;
+    namespace bfs = boost::filesystem;
+    using namespace sailfish::server;
+
+    po::options_description generic("sailfish serve options");
+    generic.add_options()
+    ("help,h", "produce help message")
+    ("index,i", po::value<string>()->required(), "The Sailfish index to load and serve.")
+    ("socket,s", po::value<string>()->required(), "The path of the Unix domain socket on which to accept "
+        "jobs.  Jobs are submitted with `sailfish quant --server <socket> ...`, with the same options as "
+        "a local quant run (including -i, which must name this index).")
+    ("jobs,j", po::value<uint32_t>()->default_value(1), "The number of jobs to run at the same time.  Each "
+        "one uses the number of threads given by its own --threads option.")
+    ;
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(generic).run(), vm);
+        if (vm.count("help")) {
+            auto hstring = R"(
+serve
+==========
+Loads a Sailfish index once, and runs the quant jobs submitted to it
+over a Unix domain socket
+)";
+            std::cout << hstring << std::endl;
+            std::cout << generic << std::endl;
+            std::exit(1);
+        }
+        po::notify(vm);
+    } catch (po::error& e) {
+        std::cerr << "Exception: [" << e.what() << "]. Exiting.\n";
+        std::exit(1);
+    }
+
+    string socketPath = vm["socket"].as<string>();
+    uint32_t maxJobs = std::max(1u, vm["jobs"].as<uint32_t>());
+
+    auto consoleSink = std::make_shared<spdlog::sinks::stderr_sink_mt>();
+    auto serveLog = spdlog::create("serveLog", {consoleSink});
+
+    std::shared_ptr<SailfishIndex> index = std::make_shared<SailfishIndex>(serveLog);
+    try {
+        index->load(bfs::path(vm["index"].as<string>()));
+    } catch (std::exception& e) {
+        serveLog->error("Couldn't load the index: {}", e.what());
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    try {
+        addr = socketAddress(socketPath);
+    } catch (std::invalid_argument& e) {
+        serveLog->error("{}", e.what());
+        return 1;
+    }
+    // Replace the socket of a previous server, but nothing else
+    struct stat st;
+    if (lstat(socketPath.c_str(), &st) == 0 and S_ISSOCK(st.st_mode)) {
+        unlink(socketPath.c_str());
+    }
+    if (listener < 0 or
+        bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 or
+        listen(listener, 64) != 0) {
+        serveLog->error("Couldn't listen on {} [{}]", socketPath, std::strerror(errno));
+        return 1;
+    }
+
+    // Stop (and remove the socket) on SIGINT or SIGTERM; accept() is
+    // interrupted rather than restarted, so that the flag is seen.
+    struct sigaction stopAction;
+    std::memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = handleStopSignal;
+    sigaction(SIGINT, &stopAction, nullptr);
+    sigaction(SIGTERM, &stopAction, nullptr);
+    // A client that goes away shouldn't kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    serveLog->info("Serving {} on {} (at most {} concurrent jobs)",
+                   vm["index"].as<string>(), socketPath, maxJobs);
+    uint32_t numActive{0};
+    uint64_t numJobs{0};
+    while (!stopServer) {
+        // Reap the handlers of finished jobs, and wait for one if
+        // there are too many running
+        while (numActive > 0 and waitpid(-1, nullptr, WNOHANG) > 0) { --numActive; }
+        while (numActive >= maxJobs and !stopServer) {
+            if (waitpid(-1, nullptr, 0) > 0) { --numActive; }
+        }
+        if (stopServer) { break; }
+
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) { continue; }
+        serveLog->flush();
+        pid_t handler = fork();
+        if (handler == 0) {
+            close(listener);
+            int32_t status = runJob(conn, index);
+            writeAll(conn, reinterpret_cast<const char*>(&status), sizeof(status));
+            close(conn);
+            _exit(0);
+        }
+        close(conn);
+        if (handler > 0) {
+            ++numActive;
+            ++numJobs;
+        } else {
+            serveLog->warn("Couldn't start a job [{}]", std::strerror(errno));
+        }
+    }
+
+    serveLog->info("Stopping after {} jobs", numJobs);
+    close(listener);
+    unlink(socketPath.c_str());
+    while (waitpid(-1, nullptr, 0) > 0) {}
+    return 0;
+}
@@ -121,11 +121,22 @@ namespace sailfish {
                     }
                 }
                 if (opt.string_key == "mates1") {
+                    // Interleaved and separate mate files go in different libraries
+                    if (peLibs.back().isInterleaved()) { peLibs.emplace_back(peFormat); }
                     peLibs.back().addMates1(opt.value);
                 }
                 if (opt.string_key == "mates2") {
+                    if (peLibs.back().isInterleaved()) { peLibs.emplace_back(peFormat); }
                     peLibs.back().addMates2(opt.value);
                 }
+                if (opt.string_key == "interleaved") {
+                    if (peLibs.back().mates1().size() > 0 or
+                        peLibs.back().mates2().size() > 0 or
+                        peLibs.back().isInterleaved()) {
+                        peLibs.emplace_back(peFormat);
+                    }
+                    peLibs.back().addInterleaved(opt.value);
+                }
                 if (opt.string_key == "unmatedReads") {
                     seLibs.back().addUnmated(opt.value);
                 }
@@ -140,7 +151,8 @@ namespace sailfish {
                         continue;
                     }
                 } else if (lib.format().type == ReadType::PAIRED_END) {
-                    if (lib.mates1().size() == 0 or lib.mates2().size() == 0) {
+                    if (!lib.isInterleaved() and
+                        (lib.mates1().size() == 0 or lib.mates2().size() == 0)) {
                         // Didn't use default paired-end library type
                         continue;
                     }
@@ -239,6 +251,25 @@ namespace sailfish {
         }
 
 
+        LibraryCompatibility::LibraryCompatibility(const LibraryFormat& expected) {
+            MateStatus mates[] = {MateStatus::SINGLE_END,
+                                  MateStatus::PAIRED_END_LEFT,
+                                  MateStatus::PAIRED_END_RIGHT};
+            for (auto ms : mates) {
+                for (bool isForward : {false, true}) {
+                    single_[mateIndex(ms)][isForward] = compatibleHit(expected, 0, isForward, ms);
+                }
+            }
+            // Paired mappings are never checked this way
+            single_[3][0] = single_[3][1] = false;
+
+            for (uint32_t id = 0; id <= LibraryFormat::maxLibTypeID(); ++id) {
+                auto observed = LibraryFormat::formatFromID(id);
+                paired_[id] = (observed.type == ReadType::PAIRED_END) and
+                              compatibleHit(expected, observed);
+            }
+        }
+
         // Determine the library type of paired-end reads
         LibraryFormat hitType(int32_t end1Start, bool end1Fwd, uint32_t len1,
                               int32_t end2Start, bool end2Fwd, uint32_t len2, bool canDovetail) {
@@ -695,6 +726,12 @@ namespace sailfish {
             // How much to cut off
             int32_t trunc = K;
 
+            // The forward and reverse complement k-mer index at each
+            // position of the current transcript
+            std::vector<uint32_t> fwdKmers;
+            std::vector<uint32_t> rcKmers;
+            std::vector<uint32_t> kmerCodes;
+
             for(size_t it=0; it < transcripts.size(); ++it) {
               auto& txp = transcripts[it];
 
@@ -716,26 +753,20 @@ namespace sailfish {
               double contribution = (alphas[it]/effLensIn(it));
 
               // This transcript's sequence
-              const char* tseq = txp.Sequence();
+              const PackedSequenceView& tseq = txp.Sequence();
 
-              // From the start of the transcript up until the last valid
-              // kmer.
-              bool firstKmer{true};
-              uint32_t idx{0};
+              if (seqBiasCorrect and refLen > trunc) {
+                tseq.kmerIndices(refLen - trunc, K, Direction::REVERSE_COMPLEMENT, rcKmers, kmerCodes);
+                tseq.kmerIndices(refLen - trunc, K, Direction::FORWARD, fwdKmers, kmerCodes);
+              }
 
               // For each position along the transcript
               // (considering the forward direction for sequence-specific bias).
               for (int32_t i = refLen - trunc - 1; i >= 0; --i) {
                 // Seq bias
                 if (seqBiasCorrect) {
-                  int32_t kmerStartPos = i;
                   int32_t fragStartPos = i + 2;
-                  if (firstKmer) {
-                    idx = indexForKmer(tseq + i, K, Direction::REVERSE_COMPLEMENT);
-                    firstKmer = false;
-                  } else {
-                    idx = nextKmerIndex(idx, tseq[kmerStartPos], K, Direction::REVERSE_COMPLEMENT);
-                  }
+                  uint32_t idx = rcKmers[i];
 
                   int32_t maxFragLen = refLen - fragStartPos + 1;
                   if (maxFragLen >= 0 and maxFragLen < refLen) {
@@ -762,19 +793,11 @@ namespace sailfish {
 
 
                 // Then in the reverse complement direction
-                firstKmer = true;
-                idx = 0;
                 if (seqBiasCorrect) {
                   for (int32_t i = 0; i <= refLen - trunc - 1; ++i) {
                     int32_t kmerStartPos = i;
-                    int32_t kmerEndPos = kmerStartPos + K - 1; // -1 because pos is *inclusive*
                     int32_t fragStartPos = kmerStartPos + 4;
-                    if (firstKmer) {
-                      idx = indexForKmer(tseq, K, Direction::FORWARD);
-                      firstKmer = false;
-                    } else {
-                      idx = nextKmerIndex(idx, tseq[kmerEndPos], K, Direction::FORWARD);
-                    }
+                    uint32_t idx = fwdKmers[i];
 
                     int32_t maxFragLen = fragStartPos + 1;
                     if (maxFragLen >= 0 and maxFragLen < refLen) {
@@ -828,22 +851,20 @@ namespace sailfish {
                 gcFactors.setZero();
 
                 if (alphas[it] >= minAlpha and unprocessedLen > 0) {
-                  bool firstKmer{true};
-                  uint32_t idx{0};
                   // This transcript's sequence
-                  const char* tseq = txp.Sequence();
+                  const PackedSequenceView& tseq = txp.Sequence();
+
+                  if (seqBiasCorrect and refLen > trunc) {
+                    tseq.kmerIndices(refLen - trunc, K, Direction::REVERSE_COMPLEMENT, rcKmers, kmerCodes);
+                    tseq.kmerIndices(refLen - trunc, K, Direction::FORWARD, fwdKmers, kmerCodes);
+                  }
 
                   for (int32_t i = refLen - trunc - 1; i >= 0; --i) {
                     /** Seq-specific bias **/
                     if (seqBiasCorrect) {
                       int32_t kmerStartPos = i;
                       int32_t fragStartPos = kmerStartPos + 2;
-                      if (firstKmer) {
-                        idx = indexForKmer(tseq + i, K, Direction::REVERSE_COMPLEMENT);
-                        firstKmer = false;
-                      } else {
-                        idx = nextKmerIndex(idx, tseq[kmerStartPos], K, Direction::REVERSE_COMPLEMENT);
-                      }
+                      uint32_t idx = rcKmers[kmerStartPos];
 
                       int32_t maxFragLen = refLen - fragStartPos + 1;
                       if (fragStartPos >=0 and fragStartPos < refLen) {
@@ -875,19 +896,11 @@ namespace sailfish {
 
                     // Then in the reverse complement direction
                     double seqNormFactor{0.0};
-                    firstKmer = true;
-                    idx = 0;
                     if (seqBiasCorrect) {
                       for (int32_t i = 0; i <= refLen - trunc - 1; ++i) {
                         int32_t kmerStartPos = i;
-                        int32_t kmerEndPos = kmerStartPos + K - 1; // -1 because pos is *inclusive*
                         int32_t fragStartPos = kmerStartPos + 4;
-                        if (firstKmer) {
-                          idx = indexForKmer(tseq, K, Direction::FORWARD);
-                          firstKmer = false;
-                        } else {
-                          idx = nextKmerIndex(idx, tseq[kmerEndPos], K, Direction::FORWARD);
-                        }
+                        uint32_t idx = fwdKmers[kmerStartPos];
 
                         int32_t maxFragLen = fragStartPos + 1;
                         if (fragStartPos >= 0 and fragStartPos < refLen) {
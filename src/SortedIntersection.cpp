@@ -0,0 +1,140 @@
+#include "SortedIntersection.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SAILFISH_X86_INTERSECTION 1
+#endif
+
+namespace sailfish {
+namespace intersection {
+
+namespace {
+
+// The index of the first element of x[i, n) that is >= v (x is sorted).
+inline size_t skipScalar(const uint32_t* x, size_t i, size_t n, uint32_t v) {
+    while (i < n and x[i] < v) { ++i; }
+    return i;
+}
+
+struct ScalarSkipper {
+    size_t operator()(const uint32_t* x, size_t i, size_t n, uint32_t v) const {
+        return skipScalar(x, i, n, v);
+    }
+};
+
+#ifdef SAILFISH_X86_INTERSECTION
+// SSE2 and AVX2 only have signed comparisons, so the sign bit of both
+// sides is flipped before comparing.
+constexpr int32_t signBit = static_cast<int32_t>(0x80000000u);
+
+struct SSE2Skipper {
+    size_t operator()(const uint32_t* x, size_t i, size_t n, uint32_t v) const {
+        const __m128i bias = _mm_set1_epi32(signBit);
+        const __m128i key = _mm_xor_si128(_mm_set1_epi32(static_cast<int32_t>(v)), bias);
+        while (i + 4 <= n) {
+            __m128i block = _mm_xor_si128(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)), bias);
+            // Since x is sorted, the lanes that are < v form a prefix
+            int lt = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, key)));
+            if (lt != 0xF) { return i + __builtin_ctz(~lt); }
+            i += 4;
+        }
+        return skipScalar(x, i, n, v);
+    }
+};
+
+__attribute__((target("avx2")))
+inline size_t skipAVX2(const uint32_t* x, size_t i, size_t n, uint32_t v) {
+    const __m256i bias = _mm256_set1_epi32(signBit);
+    const __m256i key = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int32_t>(v)), bias);
+    while (i + 8 <= n) {
+        __m256i block = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i)), bias);
+        int lt = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(key, block)));
+        if (lt != 0xFF) { return i + __builtin_ctz(~lt); }
+        i += 8;
+    }
+    return skipScalar(x, i, n, v);
+}
+
+/**
+ * The same merge as intersectWith below; it is written out again because
+ * skipAVX2 can only be inlined into a function that is also compiled
+ * for AVX2.
+ */
+__attribute__((target("avx2")))
+size_t intersectAVX2(const uint32_t* a, size_t na,
+                     const uint32_t* b, size_t nb,
+                     uint32_t* aIdx, uint32_t* bIdx,
+                     size_t limit) {
+    size_t i{0}, j{0}, m{0};
+    while (i < na and j < nb) {
+        if (a[i] < b[j]) {
+            i = skipAVX2(a, i, na, b[j]);
+        } else if (b[j] < a[i]) {
+            j = skipAVX2(b, j, nb, a[i]);
+        } else {
+            aIdx[m] = i++;
+            bIdx[m] = j++;
+            if (++m > limit) { break; }
+        }
+    }
+    return m;
+}
+
+bool haveAVX2() {
+    static bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+#endif // SAILFISH_X86_INTERSECTION
+
+template <typename SkipT>
+inline size_t intersectWith(const uint32_t* a, size_t na,
+                            const uint32_t* b, size_t nb,
+                            uint32_t* aIdx, uint32_t* bIdx,
+                            size_t limit, SkipT skip) {
+    size_t i{0}, j{0}, m{0};
+    while (i < na and j < nb) {
+        if (a[i] < b[j]) {
+            i = skip(a, i, na, b[j]);
+        } else if (b[j] < a[i]) {
+            j = skip(b, j, nb, a[i]);
+        } else {
+            aIdx[m] = i++;
+            bIdx[m] = j++;
+            if (++m > limit) { break; }
+        }
+    }
+    return m;
+}
+
+} // anonymous namespace
+
+size_t intersectSorted(const uint32_t* a, size_t na,
+                       const uint32_t* b, size_t nb,
+                       uint32_t* aIdx, uint32_t* bIdx,
+                       size_t limit) {
+    // For short lists, the plain merge is faster
+    constexpr size_t minVectorLength{32};
+    if (na + nb < minVectorLength) {
+        return intersectWith(a, na, b, nb, aIdx, bIdx, limit, ScalarSkipper());
+    }
+#ifdef SAILFISH_X86_INTERSECTION
+    if (haveAVX2()) {
+        return intersectAVX2(a, na, b, nb, aIdx, bIdx, limit);
+    }
+    return intersectWith(a, na, b, nb, aIdx, bIdx, limit, SSE2Skipper());
+#else
+    return intersectWith(a, na, b, nb, aIdx, bIdx, limit, ScalarSkipper());
+#endif
+}
+
+size_t intersectSortedScalar(const uint32_t* a, size_t na,
+                             const uint32_t* b, size_t nb,
+                             uint32_t* aIdx, uint32_t* bIdx,
+                             size_t limit) {
+    return intersectWith(a, na, b, nb, aIdx, bIdx, limit, ScalarSkipper());
+}
+
+} // namespace intersection
+} // namespace sailfish
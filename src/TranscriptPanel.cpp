@@ -0,0 +1,109 @@
+#include "TranscriptPanel.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "ReadBatch.hpp"
+#include "UtilityFunctions.hpp"
+
+namespace sailfish {
+namespace panel {
+
+namespace {
+
+/**
+ * Call f(name, header, seq, len) for every record of the FASTA file fname,
+ * where name is the header up to the first whitespace (as in the index).
+ */
+template <typename F>
+void forEachTranscript(const std::string& fname, F f) {
+    std::ifstream ifs(fname);
+    if (!ifs.good()) {
+        throw std::invalid_argument("Couldn't open the transcript file " + fname);
+    }
+    fastx_line_reader lr(ifs);
+    single_read_batch batch;
+    read_record rec;
+    while (lr.good()) {
+        batch.arena.clear();
+        read_fasta_record(lr, batch, rec, true);
+        std::string header(batch.bytes(rec.header_off), rec.header_len);
+        std::string name = header.substr(0, header.find_first_of(" \t"));
+        f(name, header, batch.bytes(rec.seq_off), rec.seq_len);
+    }
+}
+
+} // anonymous namespace
+
+PanelSummary writePanelTranscriptome(const std::string& txpFasta,
+                                     const std::string& panelFile,
+                                     uint32_t k,
+                                     const std::string& outFasta) {
+    if (k == 0 or k > 31) {
+        throw std::invalid_argument("Panel indices are only supported for k <= 31");
+    }
+    std::unordered_set<std::string> panelNames;
+    {
+        std::ifstream ifs(panelFile);
+        if (!ifs.good()) {
+            throw std::invalid_argument("Couldn't open the panel file " + panelFile);
+        }
+        std::string line;
+        while (std::getline(ifs, line)) {
+            line = line.substr(0, line.find_first_of(" \t\r"));
+            if (!line.empty()) { panelNames.insert(line); }
+        }
+    }
+
+    // The (sorted, distinct) k-mers of the panel transcripts
+    std::vector<uint64_t> panelKmers;
+    std::unordered_set<std::string> found;
+    forEachTranscript(txpFasta, [&](const std::string& name, const std::string&,
+                                    const char* seq, size_t len) {
+            if (panelNames.count(name) == 0) { return; }
+            found.insert(name);
+            forEachCanonicalKmer(seq, len, k, [&panelKmers](uint64_t kmer) -> bool {
+                    panelKmers.push_back(kmer);
+                    return false;
+            });
+    });
+    if (found.empty()) {
+        throw std::invalid_argument("None of the transcripts in " + panelFile +
+                                    " were found in " + txpFasta);
+    }
+    std::sort(panelKmers.begin(), panelKmers.end());
+    panelKmers.erase(std::unique(panelKmers.begin(), panelKmers.end()), panelKmers.end());
+
+    PanelSummary summary;
+    summary.numPanel = found.size();
+    for (auto& name : panelNames) {
+        if (found.count(name) == 0) { summary.missing.push_back(name); }
+    }
+    std::sort(summary.missing.begin(), summary.missing.end());
+
+    std::ofstream ofs(outFasta);
+    forEachTranscript(txpFasta, [&](const std::string& name, const std::string& header,
+                                    const char* seq, size_t len) {
+            bool keep = panelNames.count(name) > 0;
+            if (!keep) {
+                keep = forEachCanonicalKmer(seq, len, k, [&panelKmers](uint64_t kmer) -> bool {
+                        return std::binary_search(panelKmers.begin(), panelKmers.end(), kmer);
+                });
+                summary.numNeighbours += keep;
+            }
+            if (keep) {
+                ofs << '>' << header << '\n';
+                ofs.write(seq, len);
+                ofs << '\n';
+            }
+    });
+    if (!ofs) {
+        throw std::invalid_argument("Couldn't write the panel transcripts to " + outFasta);
+    }
+    return summary;
+}
+
+} // namespace panel
+} // namespace sailfish
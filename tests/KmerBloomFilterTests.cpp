@@ -0,0 +1,79 @@
+#include <random>
+#include <string>
+
+#include "KmerBloomFilter.hpp"
+
+std::string randomSequence(std::mt19937& gen, size_t len) {
+    std::string s(len, 'A');
+    for (auto& c : s) { c = "ACGT"[gen() % 4]; }
+    return s;
+}
+
+std::string reverseComplement(const std::string& s) {
+    std::string rc(s.rbegin(), s.rend());
+    for (auto& c : rc) {
+        switch (c) {
+            case 'A': c = 'T'; break;
+            case 'C': c = 'G'; break;
+            case 'G': c = 'C'; break;
+            case 'T': c = 'A'; break;
+        }
+    }
+    return rc;
+}
+
+SCENARIO("The k-mer filter rejects only reads without an indexed k-mer") {
+    std::mt19937 gen(11);
+    // Two "transcripts", separated as they are in the index
+    std::string txome = randomSequence(gen, 50000) + "$" + randomSequence(gen, 50000);
+    KmerBloomFilter filter(31, txome.size(), 16);
+    filter.addKmers(txome.data(), txome.size());
+
+    GIVEN("Reads drawn from the transcriptome (on either strand)") {
+        size_t numRejected{0};
+        for (size_t i = 0; i < 1000; ++i) {
+            size_t start = gen() % (txome.size() - 100);
+            std::string read = txome.substr(start, 100);
+            // Reads spanning the separator can still have one valid k-mer
+            if (i % 2) { read = reverseComplement(read); }
+            if (read.find('$') == std::string::npos and
+                !filter.mayContainAnyKmer(read.data(), read.size())) {
+                ++numRejected;
+            }
+        }
+        THEN("None are rejected") {
+            REQUIRE(numRejected == 0);
+        }
+    }
+
+    GIVEN("Random reads") {
+        size_t numRejected{0};
+        for (size_t i = 0; i < 1000; ++i) {
+            std::string read = randomSequence(gen, 100);
+            numRejected += !filter.mayContainAnyKmer(read.data(), read.size());
+        }
+        THEN("Most are rejected") {
+            REQUIRE(numRejected > 800);
+        }
+    }
+
+    GIVEN("A read that is too short, or all N") {
+        THEN("It is rejected") {
+            REQUIRE(!filter.mayContainAnyKmer(txome.data(), 30));
+            std::string ns(100, 'N');
+            REQUIRE(!filter.mayContainAnyKmer(ns.data(), ns.size()));
+        }
+    }
+}
+
+SCENARIO("DUST scores separate low-complexity reads") {
+    std::mt19937 gen(5);
+    std::string polyA(100, 'A');
+    std::string dinuc;
+    for (size_t i = 0; i < 50; ++i) { dinuc += "CA"; }
+    std::string random = randomSequence(gen, 100);
+
+    REQUIRE(dustScore(polyA.data(), polyA.size()) > 40.0);
+    REQUIRE(dustScore(dinuc.data(), dinuc.size()) > 20.0);
+    REQUIRE(dustScore(random.data(), random.size()) < 3.0);
+}
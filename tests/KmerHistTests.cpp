@@ -113,3 +113,26 @@ SCENARIO("The next k-mer index function works correctly") {
 }
 
 
+
+SCENARIO("The batched k-mer encoder agrees with the rolling index") {
+    using sailfish::utils::Direction;
+    const uint32_t K = 6;
+    std::string s = "ATTCTCCACATAGTTGTCATCGAACCAGTACCCCGTAAGCGCCAACATAT";
+    size_t numKmers = s.size() - K + 1;
+    std::vector<uint32_t> idx, codes;
+
+    GIVEN("The string " + s) {
+        kmerIndices(s.c_str(), numKmers, K, Direction::FORWARD, idx, codes);
+        THEN("the forward indices match") {
+            for (size_t i = 0; i < numKmers; ++i) {
+                REQUIRE(idx[i] == indexForKmer(s.c_str() + i, K, Direction::FORWARD));
+            }
+        }
+        kmerIndices(s.c_str(), numKmers, K, Direction::REVERSE_COMPLEMENT, idx, codes);
+        THEN("the reverse complement indices match") {
+            for (size_t i = 0; i < numKmers; ++i) {
+                REQUIRE(idx[i] == indexForKmer(s.c_str() + i, K, Direction::REVERSE_COMPLEMENT));
+            }
+        }
+    }
+}
@@ -164,3 +164,47 @@ SCENARIO("Single-end library types have proper compatibility") {
 }
 
 
+
+SCENARIO("The library compatibility table agrees with compatibleHit") {
+
+    using sailfish::utils::compatibleHit;
+    using sailfish::utils::hitType;
+    using sailfish::utils::hitTypeID;
+    using sailfish::utils::LibraryCompatibility;
+    using sailfish::utils::MateStatus;
+
+    GIVEN("Every valid library format") {
+        for (uint8_t id = 0; id <= LibraryFormat::maxLibTypeID(); ++id) {
+            auto expected = LibraryFormat::formatFromID(id);
+            if (!expected.check()) { continue; }
+            LibraryCompatibility table(expected);
+
+            std::stringstream ss;
+            ss << expected;
+            WHEN("expected is " + ss.str()) {
+                THEN("the single-end and orphan entries match") {
+                    for (auto s : {MateStatus::SINGLE_END, MateStatus::PAIRED_END_LEFT,
+                                   MateStatus::PAIRED_END_RIGHT}) {
+                        for (bool fwd : {true, false}) {
+                            REQUIRE(table.compatible(s, fwd) == compatibleHit(expected, 0, fwd, s));
+                        }
+                    }
+                }
+                THEN("the paired-end entries match") {
+                    for (bool fwd1 : {true, false}) {
+                        for (bool fwd2 : {true, false}) {
+                            for (int32_t start2 : {0, 50, 100, 200}) {
+                                for (bool dovetail : {true, false}) {
+                                    auto observed = hitType(100, fwd1, 75, start2, fwd2, 75, dovetail);
+                                    auto observedID = hitTypeID(100, fwd1, 75, start2, fwd2, 75, dovetail);
+                                    REQUIRE(observedID == observed.formatID());
+                                    REQUIRE(table.compatible(observedID) == compatibleHit(expected, observed));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "PackedSequence.hpp"
+#include "UtilityFunctions.hpp"
+
+SCENARIO("A packed sequence matches the sequence it was built from") {
+    using sailfish::utils::Direction;
+    std::mt19937 gen(7);
+    std::string s(1000, 'A');
+    for (auto& c : s) { c = "ACGTacgt"[gen() % 8]; }
+    // Runs of Ns, and other characters, including at the ends
+    s.replace(0, 3, "NNN");
+    s.replace(100, 40, std::string(40, 'N'));
+    s[500] = '$';
+    s[999] = 'N';
+    PackedSequence packed(s.data(), s.size());
+
+    GIVEN("A copy saved to, and mapped from, a file") {
+        auto path = boost::filesystem::temp_directory_path() /
+                    boost::filesystem::unique_path("sailfish-%%%%-%%%%.bin");
+        packed.save(path.string());
+        PackedSequence mapped;
+        mapped.load(path.string());
+        THEN("It is mapped, and decodes to the same sequence") {
+            REQUIRE(mapped.isMapped());
+            REQUIRE(mapped.decode(0, mapped.size()) == packed.decode(0, packed.size()));
+        }
+        boost::filesystem::remove(path);
+    }
+
+    GIVEN("A view of part of it") {
+        size_t offset{90};
+        size_t len{800};
+        PackedSequenceView view(&packed, offset, len);
+        std::string sub = s.substr(offset, len);
+
+        THEN("It decodes to the upper-case bases, with Ns for other characters") {
+            std::string expected(sub);
+            for (auto& c : expected) {
+                c = (nucleotideEncoding[static_cast<uint8_t>(c)] & invalidNucleotide) ?
+                    'N' : std::toupper(c);
+            }
+            REQUIRE(view.str() == expected);
+        }
+
+        THEN("The GC counts match") {
+            for (size_t start : {0, 7, 33, 64, 311}) {
+                for (size_t n : {1, 31, 32, 100, 450}) {
+                    size_t gc{0};
+                    for (size_t i = start; i < start + n; ++i) {
+                        auto c = std::toupper(sub[i]);
+                        gc += (c == 'G' or c == 'C');
+                    }
+                    REQUIRE(view.gcCount(start, n) == gc);
+                }
+            }
+        }
+
+        THEN("The k-mer indices match those of the characters") {
+            std::vector<uint32_t> expected, idx, codes;
+            for (auto dir : {Direction::FORWARD, Direction::REVERSE_COMPLEMENT}) {
+                kmerIndices(sub.data(), len - 5, 6, dir, expected, codes);
+                view.kmerIndices(len - 5, 6, dir, idx, codes);
+                REQUIRE(idx == expected);
+                for (size_t i = 0; i < len - 5; ++i) {
+                    REQUIRE(view.kmerIndex(i, 6, dir) == indexForKmer(sub.data() + i, 6, dir));
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+#include <boost/filesystem.hpp>
+
+#include "ReadStream.hpp"
+
+/**
+ * Compress s with zlib; windowBits selects a gzip member (15 + 16) or
+ * raw deflate data (-15).
+ */
+std::string deflateString(const std::string& s, int windowBits) {
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&zs, s.size()) + 32, '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(s.data()));
+    zs.avail_in = s.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    deflate(&zs, Z_FINISH);
+    out.resize(out.size() - zs.avail_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+void appendLE(std::string& s, uint32_t v, size_t numBytes) {
+    for (size_t i = 0; i < numBytes; ++i) { s.push_back(static_cast<char>((v >> (8 * i)) & 0xff)); }
+}
+
+// A BGZF block holding s
+std::string bgzfBlock(const std::string& s) {
+    std::string data = deflateString(s, -15);
+    std::string block("\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff\x06\x00\x42\x43\x02\x00", 16);
+    appendLE(block, 18 + data.size() + 8 - 1, 2);
+    block += data;
+    appendLE(block, crc32(0, reinterpret_cast<const Bytef*>(s.data()), s.size()), 4);
+    appendLE(block, s.size(), 4);
+    return block;
+}
+
+std::string readWholeStream(const std::string& fname) {
+    auto is = sailfish::io::openReadStream(fname, 2);
+    return std::string(std::istreambuf_iterator<char>(*is), std::istreambuf_iterator<char>());
+}
+
+std::string writeTempFile(const std::string& contents) {
+    auto path = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("sailfish-%%%%-%%%%.gz");
+    std::ofstream ofs(path.string(), std::ios::binary);
+    ofs << contents;
+    return path.string();
+}
+
+SCENARIO("Compressed reads are decompressed transparently") {
+    std::string record(">read\nACGTACGTTTGACCA\n");
+
+    GIVEN("BGZF files with a number of data blocks around the batch size") {
+        THEN("They are read back in full") {
+            for (size_t numBlocks : {1, 63, 64, 65, 128}) {
+                std::string expected;
+                std::string file;
+                for (size_t i = 0; i < numBlocks; ++i) {
+                    std::string contents = record + std::to_string(i) + "\n";
+                    expected += contents;
+                    file += bgzfBlock(contents);
+                }
+                // The empty EOF marker block
+                file += bgzfBlock("");
+                auto fname = writeTempFile(file);
+                std::string contents;
+                REQUIRE_NOTHROW(contents = readWholeStream(fname));
+                REQUIRE(contents == expected);
+                boost::filesystem::remove(fname);
+            }
+        }
+    }
+
+    GIVEN("A multi-member gzip file") {
+        std::string first(record);
+        std::string second(500, 'A');
+        std::string file = deflateString(first, 15 + 16) + deflateString(second, 15 + 16);
+        auto fname = writeTempFile(file);
+        auto truncName = writeTempFile(file.substr(0, file.size() - 6));
+        THEN("It is read in full") {
+            REQUIRE(readWholeStream(fname) == first + second);
+        }
+        THEN("Truncating its last member is an error") {
+            REQUIRE_THROWS(readWholeStream(truncName));
+        }
+        boost::filesystem::remove(fname);
+        boost::filesystem::remove(truncName);
+    }
+}
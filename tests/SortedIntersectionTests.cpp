@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "SortedIntersection.hpp"
+
+// Sorted list of n transcript IDs drawn from [0, universe)
+std::vector<uint32_t> randomSortedIDs(std::mt19937& gen, size_t n, uint32_t universe) {
+    std::uniform_int_distribution<uint32_t> dis(0, universe - 1);
+    std::vector<uint32_t> ids(n);
+    for (auto& id : ids) { id = dis(gen); }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// The matches found by the scalar merge over two sorted lists
+size_t referenceIntersection(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                             std::vector<uint32_t>& aIdx, std::vector<uint32_t>& bIdx) {
+    size_t i{0}, j{0};
+    aIdx.clear(); bIdx.clear();
+    while (i < a.size() and j < b.size()) {
+        if (a[i] < b[j]) { ++i; }
+        else if (b[j] < a[i]) { ++j; }
+        else { aIdx.push_back(i++); bIdx.push_back(j++); }
+    }
+    return aIdx.size();
+}
+
+SCENARIO("Sorted intersection matches the scalar merge") {
+    using sailfish::intersection::intersectSorted;
+    std::mt19937 gen(42);
+
+    GIVEN("Random lists of transcript IDs (with duplicates) of many sizes") {
+        bool allMatch{true};
+        bool limitsHonored{true};
+        for (size_t trial = 0; trial < 2000; ++trial) {
+            size_t na = gen() % 70;
+            size_t nb = gen() % 70;
+            uint32_t universe = 1 + gen() % 200;
+            auto a = randomSortedIDs(gen, na, universe);
+            auto b = randomSortedIDs(gen, nb, universe);
+            // Some IDs use the top bit, to check the unsigned comparisons
+            if (trial % 3 == 0) {
+                for (auto& x : a) { x += 0x80000000u; }
+                for (auto& x : b) { x += 0x80000000u; }
+            }
+
+            std::vector<uint32_t> refA, refB;
+            size_t numRef = referenceIntersection(a, b, refA, refB);
+
+            std::vector<uint32_t> aIdx(std::max(na, nb) + 1), bIdx(std::max(na, nb) + 1);
+            size_t num = intersectSorted(a.data(), na, b.data(), nb,
+                                         aIdx.data(), bIdx.data(), na + nb);
+            aIdx.resize(num); bIdx.resize(num);
+            allMatch = allMatch and (num == numRef) and (aIdx == refA) and (bIdx == refB);
+
+            // With a limit, it must stop after limit + 1 matches
+            size_t limit = gen() % 5;
+            num = intersectSorted(a.data(), na, b.data(), nb,
+                                  aIdx.data(), bIdx.data(), limit);
+            limitsHonored = limitsHonored and (num == std::min(numRef, limit + 1));
+        }
+        THEN("The matched index pairs are the same") {
+            REQUIRE(allMatch);
+            REQUIRE(limitsHonored);
+        }
+    }
+}
+
+// Run with: unitTests "[benchmark]"
+SCENARIO("Sorted intersection benchmark", "[.][benchmark]") {
+    using sailfish::intersection::intersectSorted;
+    using sailfish::intersection::intersectSortedScalar;
+    using Clock = std::chrono::steady_clock;
+    std::mt19937 gen(7);
+
+    // (left hits, right hits) per fragment: typical, skewed and repeat-derived
+    std::vector<std::pair<size_t, size_t>> sizes{{8, 8}, {40, 40}, {20, 400}, {5000, 5000}};
+    for (auto& s : sizes) {
+        constexpr size_t numLists{256};
+        std::vector<std::vector<uint32_t>> as, bs;
+        for (size_t i = 0; i < numLists; ++i) {
+            // Mates tend to hit the same transcripts, so draw both from a
+            // range that's only a few times larger than the lists
+            uint32_t universe = 3 * std::max(s.first, s.second);
+            as.push_back(randomSortedIDs(gen, s.first, universe));
+            bs.push_back(randomSortedIDs(gen, s.second, universe));
+        }
+        std::vector<uint32_t> aIdx(s.first + s.second + 1), bIdx(s.first + s.second + 1);
+        size_t reps = std::max(size_t(1), size_t(20000000) / (numLists * (s.first + s.second)));
+
+        size_t checksum{0};
+        auto start = Clock::now();
+        for (size_t r = 0; r < reps; ++r) {
+            for (size_t i = 0; i < numLists; ++i) {
+                checksum += intersectSortedScalar(as[i].data(), as[i].size(), bs[i].data(), bs[i].size(),
+                                                  aIdx.data(), bIdx.data(), s.first + s.second);
+            }
+        }
+        double scalarNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (reps * numLists);
+
+        start = Clock::now();
+        for (size_t r = 0; r < reps; ++r) {
+            for (size_t i = 0; i < numLists; ++i) {
+                checksum -= intersectSorted(as[i].data(), as[i].size(), bs[i].data(), bs[i].size(),
+                                            aIdx.data(), bIdx.data(), s.first + s.second);
+            }
+        }
+        double simdNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (reps * numLists);
+
+        std::cerr << s.first << " x " << s.second << " hits: scalar " << scalarNs
+                  << " ns, simd " << simdNs << " ns per intersection\n";
+        REQUIRE(checksum == 0);
+    }
+}
@@ -1,6 +1,7 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <unordered_map>
 #include <iostream>
+#include <sstream>
 #include "catch.hpp"
 #include "LibraryFormat.hpp"
 #include "SailfishUtils.hpp"
@@ -9,3 +10,7 @@ bool verbose=false; // Apparently, we *need* this (OSX)
 
 #include "LibraryTypeTests.cpp"
 #include "KmerHistTests.cpp"
+#include "SortedIntersectionTests.cpp"
+#include "ReadStreamTests.cpp"
+#include "KmerBloomFilterTests.cpp"
+#include "PackedSequenceTests.cpp"